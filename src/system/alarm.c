@@ -37,6 +37,7 @@
 #include "msgid.h"
 #include "alarm.h"
 #include "android_alarm.h"
+#include "syscall_stats.h"
 
 /**
  * @addtogroup RTCAlarms
@@ -45,8 +46,6 @@
 
 int32_t alarm_fd = -1;
 
-static time_t curr_expiry = 0;
-
 /**
  * @brief Open Android Alarm device.
  *
@@ -56,7 +55,8 @@ bool android_alarm_open()
 	if (alarm_fd >= 0)
 		return true;
 
-	alarm_fd = open("/dev/alarm", O_RDWR);
+	syscall_stats_inc(SYSCALL_DEV_OPEN);
+	alarm_fd = open("/dev/alarm", O_RDWR | O_CLOEXEC);
 	if (alarm_fd < 0) {
 		g_critical("Could not open rtc driver. %d", errno);
 		return false;
@@ -72,6 +72,7 @@ void android_alarm_close()
 {
 	if (alarm_fd >= 0)
 	{
+		syscall_stats_inc(SYSCALL_DEV_CLOSE);
 		close(alarm_fd);
 		alarm_fd = -1;
 	}
@@ -90,6 +91,7 @@ bool android_alarm_read(struct tm *tm_time)
 
 	struct timespec alarm_time = { .tv_sec = 0, .tv_nsec = 0 };
 
+	syscall_stats_inc(SYSCALL_ANDROID_ALARM_GET_TIME);
 	int32_t ret = ioctl(alarm_fd, ANDROID_ALARM_GET_TIME(ANDROID_ALARM_RTC), &alarm_time);
 	if (ret < 0) {
 		nyx_warn(MSGID_NYX_HYBRIS_ANDROID_ALARM_GET_TIME_ERR, 0, "ANDROID_ALARM_GET_TIME(ANDROID_ALARM_SYSTEMTIME) ioctl %d", errno);
@@ -129,42 +131,26 @@ time_t android_alarm_time(time_t *time)
 /**
 * @brief Sets an rtc alarm to fire.
 *
-* Alarm expiry will be floored at 2 seconds in the future
-* (i.e. if expiry = now + 1, alarm will fire at now + 2).
+* The driver keeps nanosecond resolution and fires expiries in the
+* past right away, so no flooring is applied.
 *
 * @param  expiry
 *
 * @retval
 */
 
-bool android_alarm_set(time_t expiry)
+bool android_alarm_set(const struct timespec *expiry)
 {
-	time_t now = 0;
-	struct timespec wakeup_time = { .tv_sec = 0, .tv_nsec = 0 };
 	int rc;
 
-	printf("%s\n", __FUNCTION__);
-
-	if (expiry == curr_expiry)
-		return true;
-
-	android_alarm_time(&now);
-
-	if (expiry < now + 2) {
-		g_debug("%s: expiry = now + 2", __FUNCTION__);
-		expiry = now + 2;
-	}
-
-	wakeup_time.tv_sec = expiry;
-
-	rc = ioctl(alarm_fd, ANDROID_ALARM_SET(ANDROID_ALARM_RTC_WAKEUP), &wakeup_time);
+	syscall_stats_inc(SYSCALL_ANDROID_ALARM_SET);
+	rc = ioctl(alarm_fd, ANDROID_ALARM_SET(ANDROID_ALARM_RTC_WAKEUP), expiry);
 	if (rc != 0) {
-		g_warning("Failed to set wakeup alarm at %ld (err %d)", expiry, rc);
+		g_warning("Failed to set wakeup alarm at %ld.%09ld (err %d)",
+		          (long)expiry->tv_sec, expiry->tv_nsec, rc);
 		return false;
 	}
 
-	curr_expiry = expiry;
-
 	return true;
 }
 
@@ -176,6 +162,7 @@ bool android_alarm_clear(void)
 {
 	g_debug("%s: clearing...", __FUNCTION__);
 
+	syscall_stats_inc(SYSCALL_ANDROID_ALARM_CLEAR);
 	if (ioctl(alarm_fd, ANDROID_ALARM_CLEAR(ANDROID_ALARM_RTC_WAKEUP)) != 0) {
 		g_warning("Failed to clear alarm");
 		return false;
@@ -184,4 +171,40 @@ bool android_alarm_clear(void)
 	return true;
 }
 
+/**
+* @brief Sets an elapsed realtime (boot clock) alarm to wake the device.
+*/
+
+bool android_alarm_set_elapsed(const struct timespec *expiry)
+{
+	int rc;
+
+	if (!android_alarm_open())
+		return false;
+
+	syscall_stats_inc(SYSCALL_ANDROID_ALARM_SET);
+	rc = ioctl(alarm_fd, ANDROID_ALARM_SET(ANDROID_ALARM_ELAPSED_REALTIME_WAKEUP), expiry);
+	if (rc != 0) {
+		g_warning("Failed to set elapsed wakeup alarm at %ld.%09ld (err %d)",
+		          (long)expiry->tv_sec, expiry->tv_nsec, rc);
+		return false;
+	}
+
+	return true;
+}
+
+bool android_alarm_clear_elapsed(void)
+{
+	if (alarm_fd < 0)
+		return true;
+
+	syscall_stats_inc(SYSCALL_ANDROID_ALARM_CLEAR);
+	if (ioctl(alarm_fd, ANDROID_ALARM_CLEAR(ANDROID_ALARM_ELAPSED_REALTIME_WAKEUP)) != 0) {
+		g_warning("Failed to clear elapsed alarm");
+		return false;
+	}
+
+	return true;
+}
+
 /* @} END OF RTCAlarms */
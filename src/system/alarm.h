@@ -29,8 +29,10 @@
 
 bool android_alarm_open();
 void android_alarm_close();
-bool android_alarm_set(time_t expiry);
+bool android_alarm_set(const struct timespec *expiry);
 bool android_alarm_clear();
+bool android_alarm_set_elapsed(const struct timespec *expiry);
+bool android_alarm_clear_elapsed();
 bool android_alarm_read(struct tm *tm_time);
 time_t android_alarm_time(time_t *time);
 
@@ -0,0 +1,288 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+****************************************************************
+* @file alarm_journal.c
+*
+* @brief Memory-mapped journal of pending alarms.
+*
+* The file holds a small header and a fixed number of slots, one per
+* pending alarm. Since it is a shared mapping every store is in the page
+* cache as soon as it is made and survives a crash of the process
+* hosting the module, so the schedule can be reloaded on restart.
+*
+* The header also holds the id of the boot the journal was written in.
+* Boot clock times mean nothing after the device rebooted, so boot clock
+* alarms are dropped when the journal is opened in another boot.
+***************************************************************
+*/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdbool.h>
+#include <glib.h>
+#include "alarm_journal.h"
+#include "timespec.h"
+
+#define JOURNAL_MAGIC   0x4e414a4cU /* "NAJL" */
+#define JOURNAL_VERSION 2
+#define JOURNAL_SLOTS   128
+#define JOURNAL_BOOT_ID_SIZE 40
+
+#define BOOT_ID "/proc/sys/kernel/random/boot_id"
+
+/**
+ * @addtogroup RTCAlarms
+ * @{
+ */
+
+struct journal_slot
+{
+	uint8_t used;
+	uint8_t clock;
+	uint8_t reserved[6];
+	int64_t earliest_ns;
+	int64_t latest_ns;
+};
+
+struct journal
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nslots;
+	uint32_t reserved;
+	char boot_id[JOURNAL_BOOT_ID_SIZE];
+	struct journal_slot slots[JOURNAL_SLOTS];
+};
+
+static struct journal *journal = NULL;
+static bool overflow_logged = false;
+
+/**
+* @brief Forget the boot clock alarms if the journal was written before
+* the device rebooted, and note the current boot.
+*/
+
+static void
+journal_check_boot(void)
+{
+	char boot_id[JOURNAL_BOOT_ID_SIZE] = "";
+	gchar *contents = NULL;
+	guint slot, dropped = 0;
+
+	if (g_file_get_contents(BOOT_ID, &contents, NULL, NULL))
+	{
+		g_strlcpy(boot_id, g_strchomp(contents), sizeof(boot_id));
+		g_free(contents);
+	}
+
+	if (!strncmp(journal->boot_id, boot_id, sizeof(boot_id)))
+	{
+		return;
+	}
+
+	for (slot = 0; slot < JOURNAL_SLOTS; slot++)
+	{
+		struct journal_slot *s = &journal->slots[slot];
+
+		if (s->used && s->clock == ALARM_CLOCK_BOOTTIME)
+		{
+			__atomic_store_n(&s->used, 0, __ATOMIC_RELEASE);
+			dropped++;
+		}
+	}
+
+	if (dropped)
+	{
+		g_message("Dropped %u boot clock alarms journalled before the last reboot",
+		          dropped);
+	}
+
+	memcpy(journal->boot_id, boot_id, sizeof(boot_id));
+}
+
+/**
+* @brief Map the journal at path, creating or resetting it if it is
+* missing or was written by an incompatible version.
+*/
+
+bool
+alarm_journal_open(const char *path)
+{
+	struct stat st;
+	int fd;
+
+	if (journal)
+	{
+		return true;
+	}
+
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+
+	if (fd < 0)
+	{
+		g_warning("%s: could not open %s %d", __FUNCTION__, path, errno);
+		return false;
+	}
+
+	if (fstat(fd, &st) < 0 ||
+	    (st.st_size != sizeof(struct journal) && ftruncate(fd, 0) < 0) ||
+	    ftruncate(fd, sizeof(struct journal)) < 0)
+	{
+		g_warning("%s: could not size %s %d", __FUNCTION__, path, errno);
+		close(fd);
+		return false;
+	}
+
+	journal = mmap(NULL, sizeof(struct journal), PROT_READ | PROT_WRITE,
+	               MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (journal == MAP_FAILED)
+	{
+		g_warning("%s: could not map %s %d", __FUNCTION__, path, errno);
+		journal = NULL;
+		return false;
+	}
+
+	if (journal->magic != JOURNAL_MAGIC || journal->version != JOURNAL_VERSION ||
+	    journal->nslots != JOURNAL_SLOTS)
+	{
+		memset(journal, 0, sizeof(struct journal));
+		journal->version = JOURNAL_VERSION;
+		journal->nslots = JOURNAL_SLOTS;
+		__atomic_store_n(&journal->magic, JOURNAL_MAGIC, __ATOMIC_RELEASE);
+	}
+
+	journal_check_boot();
+
+	return true;
+}
+
+void
+alarm_journal_close(void)
+{
+	if (journal)
+	{
+		munmap(journal, sizeof(struct journal));
+		journal = NULL;
+	}
+}
+
+/**
+* @brief Write an alarm to the journal.
+*
+* @param slot slot previously returned for this alarm, or -1
+*
+* @retval slot the alarm was written to, -1 if it could not be stored
+*/
+
+int
+alarm_journal_store(int slot, AlarmClock clock, const struct timespec *earliest,
+                    const struct timespec *latest)
+{
+	struct journal_slot *s;
+
+	if (!journal)
+	{
+		return -1;
+	}
+
+	if (slot < 0)
+	{
+		for (slot = 0; slot < JOURNAL_SLOTS; slot++)
+		{
+			if (!journal->slots[slot].used)
+			{
+				break;
+			}
+		}
+
+		if (slot == JOURNAL_SLOTS)
+		{
+			if (!overflow_logged)
+			{
+				g_warning("%s: journal full, further alarms are not persisted",
+				          __FUNCTION__);
+				overflow_logged = true;
+			}
+
+			return -1;
+		}
+	}
+
+	s = &journal->slots[slot];
+
+	/* mark the slot unused while it is rewritten so a crash in between
+	 * never leaves a half-written alarm behind */
+	__atomic_store_n(&s->used, 0, __ATOMIC_RELEASE);
+	s->clock = clock;
+	s->earliest_ns = timespec_to_ns(earliest);
+	s->latest_ns = timespec_to_ns(latest);
+	__atomic_store_n(&s->used, 1, __ATOMIC_RELEASE);
+
+	return slot;
+}
+
+void
+alarm_journal_remove(int slot)
+{
+	if (journal && slot >= 0 && slot < JOURNAL_SLOTS)
+	{
+		__atomic_store_n(&journal->slots[slot].used, 0, __ATOMIC_RELEASE);
+	}
+}
+
+/**
+* @brief Call func for every alarm in the journal.
+*/
+
+void
+alarm_journal_foreach(AlarmJournalFunc func, void *data)
+{
+	int slot;
+
+	if (!journal)
+	{
+		return;
+	}
+
+	for (slot = 0; slot < JOURNAL_SLOTS; slot++)
+	{
+		struct journal_slot *s = &journal->slots[slot];
+		struct timespec earliest, latest;
+
+		if (!__atomic_load_n(&s->used, __ATOMIC_ACQUIRE) || s->clock >= ALARM_CLOCK_COUNT)
+		{
+			continue;
+		}
+
+		earliest = timespec_from_ns(s->earliest_ns);
+		latest = timespec_from_ns(s->latest_ns);
+		func(slot, s->clock, &earliest, &latest, data);
+	}
+}
+
+/* @} END OF RTCAlarms */
@@ -0,0 +1,44 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************
+* @file alarm_journal.h
+*******************************************
+*/
+
+#ifndef _ALARM_JOURNAL_H_
+#define _ALARM_JOURNAL_H_
+
+#include <stdbool.h>
+#include <time.h>
+#include "wakeup.h"
+
+typedef void (*AlarmJournalFunc)(int slot, AlarmClock clock,
+                                 const struct timespec *earliest,
+                                 const struct timespec *latest, void *data);
+
+bool alarm_journal_open(const char *path);
+void alarm_journal_close(void);
+int alarm_journal_store(int slot, AlarmClock clock,
+                        const struct timespec *earliest,
+                        const struct timespec *latest);
+void alarm_journal_remove(int slot);
+void alarm_journal_foreach(AlarmJournalFunc func, void *data);
+
+#endif
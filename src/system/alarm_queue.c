@@ -0,0 +1,1502 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+****************************************************************
+* @file alarm_queue.c
+*
+* @brief Multiplexes any number of client alarms onto the single
+* hardware alarm. Pending alarms are kept in a min-heap ordered by
+* their latest allowed expiry and only the earliest one is programmed
+* into the hardware. Wall clock and boot clock alarms are kept in
+* separate heaps since the two clocks can move relative to each other.
+*
+* Each alarm has a window [earliest, latest]. The hardware is armed
+* for the smallest latest time in the queue and, when it fires, every
+* alarm whose window has already opened is delivered along with it.
+* Alarms with overlapping windows therefore share one wakeup.
+*
+* When a journal is configured every pending alarm is mirrored into it.
+* After a restart the journalled alarms come back as placeholders that
+* keep the wakeup armed without a callback; a client that re-registers
+* the same window takes its placeholder over, so the hardware is armed
+* once on load instead of once per re-registration. Placeholders nobody
+* claims are dropped after a grace period.
+*
+* Non-wakeup alarms live in heaps of their own. They never arm the
+* wakeup source, only a plain timer that does not run during suspend,
+* so they fire while the device is awake anyway or together with the
+* first wakeup or resume after their expiry.
+*
+* Periodic alarms are put back into the queue right after their
+* callback ran, so they cost one hardware programming per period and
+* no round trip through the client. Only their current window is
+* journalled.
+***************************************************************
+*/
+
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <glib.h>
+#include <nyx/nyx_module.h>
+#include "wakeup.h"
+#include "timespec.h"
+#include "alarm_queue.h"
+#include "alarm_journal.h"
+#include "latency_stats.h"
+#include "alarm_quota.h"
+#include "config.h"
+#include "dispatch.h"
+#include "syscall_stats.h"
+
+/**
+ * @addtogroup RTCAlarms
+ * @{
+ */
+
+struct alarm_entry
+{
+	guint id;
+	AlarmClock clock;
+	struct timespec earliest;
+	struct timespec latest;
+	/* latest as the client asked for it, before any quota deferral */
+	struct timespec requested_latest;
+	nyx_device_callback_function_t func;
+	void *context;
+	guint index;
+	int journal_slot;
+	bool placeholder;
+	int64_t interval_ns;
+	bool aligned;
+	bool cancelled;
+	bool wakeup;
+};
+
+struct alarm_heap
+{
+	struct alarm_entry **entries;
+	guint len;
+	guint size;
+};
+
+static nyx_device_handle_t queue_handle = NULL;
+/* wakeup alarms of each clock, then the non-wakeup ones */
+#define HEAP_COUNT (2 * ALARM_CLOCK_COUNT)
+
+static struct alarm_heap heaps[HEAP_COUNT];
+static guint next_id = 1;
+static bool dispatching = false;
+static guint held = 0;
+static guint saved_wakeups = 0;
+static guint placeholder_timeout = 0;
+
+/* alarms taken out of the heaps while their callbacks run */
+static struct alarm_entry **in_flight = NULL;
+static guint in_flight_len = 0;
+
+/* signalled by other threads for a fire pass where events are handled */
+static int fire_fd = -1;
+static struct dispatch_watch *fire_watch = NULL;
+
+/* told about every batch of expired alarms at once */
+static AlarmBatchFunc batch_func = NULL;
+static void *batch_data = NULL;
+
+static inline bool
+entry_before(struct alarm_entry *a, struct alarm_entry *b)
+{
+	return timespec_compare(&a->latest, &b->latest) < 0;
+}
+
+static void
+heap_swap(struct alarm_heap *heap, guint i, guint j)
+{
+	struct alarm_entry *tmp = heap->entries[i];
+
+	heap->entries[i] = heap->entries[j];
+	heap->entries[j] = tmp;
+	heap->entries[i]->index = i;
+	heap->entries[j]->index = j;
+}
+
+static void
+heap_sift_up(struct alarm_heap *heap, guint i)
+{
+	while (i > 0)
+	{
+		guint parent = (i - 1) / 2;
+
+		if (!entry_before(heap->entries[i], heap->entries[parent]))
+		{
+			break;
+		}
+
+		heap_swap(heap, i, parent);
+		i = parent;
+	}
+}
+
+static void
+heap_sift_down(struct alarm_heap *heap, guint i)
+{
+	for (;;)
+	{
+		guint left = 2 * i + 1;
+		guint right = left + 1;
+		guint smallest = i;
+
+		if (left < heap->len &&
+		    entry_before(heap->entries[left], heap->entries[smallest]))
+		{
+			smallest = left;
+		}
+
+		if (right < heap->len &&
+		    entry_before(heap->entries[right], heap->entries[smallest]))
+		{
+			smallest = right;
+		}
+
+		if (smallest == i)
+		{
+			break;
+		}
+
+		heap_swap(heap, i, smallest);
+		i = smallest;
+	}
+}
+
+static bool
+heap_push(struct alarm_heap *heap, struct alarm_entry *entry)
+{
+	if (heap->len == heap->size)
+	{
+		guint size = heap->size ? heap->size * 2 : 8;
+		struct alarm_entry **tmp = realloc(heap->entries,
+		                                   size * sizeof(*heap->entries));
+
+		if (!tmp)
+		{
+			return false;
+		}
+
+		heap->entries = tmp;
+		heap->size = size;
+	}
+
+	entry->index = heap->len;
+	heap->entries[heap->len++] = entry;
+	heap_sift_up(heap, entry->index);
+
+	return true;
+}
+
+static void
+heap_delete(struct alarm_heap *heap, struct alarm_entry *entry)
+{
+	guint i = entry->index;
+
+	heap->len--;
+
+	if (i != heap->len)
+	{
+		heap->entries[i] = heap->entries[heap->len];
+		heap->entries[i]->index = i;
+		heap_sift_up(heap, i);
+		heap_sift_down(heap, heap->entries[i]->index);
+	}
+}
+
+static void
+heap_update(struct alarm_heap *heap, struct alarm_entry *entry)
+{
+	heap_sift_up(heap, entry->index);
+	heap_sift_down(heap, entry->index);
+}
+
+static inline struct alarm_entry *
+heap_top(struct alarm_heap *heap)
+{
+	return heap->len ? heap->entries[0] : NULL;
+}
+
+static int
+compare_deadline(const void *a, const void *b)
+{
+	const struct alarm_entry *ea = *(struct alarm_entry * const *)a;
+	const struct alarm_entry *eb = *(struct alarm_entry * const *)b;
+
+	if (ea->clock != eb->clock)
+	{
+		return ea->clock < eb->clock ? -1 : 1;
+	}
+
+	return timespec_compare(&ea->latest, &eb->latest);
+}
+
+static inline struct alarm_heap *
+heap_of(AlarmClock clock, bool wakeup)
+{
+	return &heaps[wakeup ? clock : ALARM_CLOCK_COUNT + clock];
+}
+
+static inline struct alarm_heap *
+entry_heap(struct alarm_entry *entry)
+{
+	return heap_of(entry->clock, entry->wakeup);
+}
+
+static inline AlarmClock
+heap_clock(guint h)
+{
+	return h % ALARM_CLOCK_COUNT;
+}
+
+static struct alarm_entry *
+find_by_id(guint id)
+{
+	guint h, i;
+
+	for (h = 0; h < HEAP_COUNT; h++)
+	{
+		for (i = 0; i < heaps[h].len; i++)
+		{
+			if (heaps[h].entries[i]->id == id)
+			{
+				return heaps[h].entries[i];
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static struct alarm_entry *
+find_by_client(AlarmClock clock, nyx_device_callback_function_t func,
+               void *context)
+{
+	guint w, i;
+
+	for (w = 0; w < 2; w++)
+	{
+		struct alarm_heap *heap = heap_of(clock, w == 0);
+
+		for (i = 0; i < heap->len; i++)
+		{
+			if (!heap->entries[i]->placeholder &&
+			    heap->entries[i]->func == func && heap->entries[i]->context == context)
+			{
+				return heap->entries[i];
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/**
+* @brief Mark an alarm whose callback is running as cancelled, so a
+* periodic one is not queued again afterwards.
+*
+* @param id alarm id, or 0 to match clock, func and context instead
+*/
+
+static bool
+cancel_in_flight(guint id, AlarmClock clock, nyx_device_callback_function_t func,
+                 void *context)
+{
+	guint i;
+
+	for (i = 0; i < in_flight_len; i++)
+	{
+		struct alarm_entry *entry = in_flight[i];
+
+		if (entry->cancelled)
+		{
+			continue;
+		}
+
+		if (id ? entry->id == id :
+		    (entry->clock == clock && entry->func == func && entry->context == context))
+		{
+			entry->cancelled = true;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+* @brief Placeholder restored from the journal with exactly the given
+* window, if any.
+*/
+
+static struct alarm_entry *
+find_placeholder(AlarmClock clock, const struct timespec *earliest,
+                 const struct timespec *latest)
+{
+	struct alarm_heap *heap = heap_of(clock, true);
+	guint i;
+
+	for (i = 0; i < heap->len; i++)
+	{
+		struct alarm_entry *entry = heap->entries[i];
+
+		if (entry->placeholder &&
+		    timespec_compare(&entry->earliest, earliest) == 0 &&
+		    timespec_compare(&entry->latest, latest) == 0)
+		{
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+entry_free(struct alarm_entry *entry)
+{
+	alarm_journal_remove(entry->journal_slot);
+	free(entry);
+}
+
+static inline void
+entry_journal(struct alarm_entry *entry)
+{
+	/* restored alarms come back as wakeup alarms, so a non-wakeup one
+	 * must not end up in the journal */
+	if (!entry->wakeup)
+	{
+		alarm_journal_remove(entry->journal_slot);
+		entry->journal_slot = -1;
+		return;
+	}
+
+	/* a client re-registering after a restart asks for the window it
+	 * asked for before, not the one its quota pushed out */
+	entry->journal_slot = alarm_journal_store(entry->journal_slot, entry->clock,
+	                                          &entry->earliest,
+	                                          &entry->requested_latest);
+}
+
+/**
+* @brief Hand the earliest pending alarm of each clock to the wakeup
+* backend, which clears whatever is no longer needed.
+*/
+
+static bool
+alarm_queue_rearm(void)
+{
+	struct timespec expiry[ALARM_CLOCK_COUNT];
+	struct timespec lazy[ALARM_CLOCK_COUNT];
+	guint c;
+
+	if (dispatching || held)
+	{
+		return true;
+	}
+
+	for (c = 0; c < ALARM_CLOCK_COUNT; c++)
+	{
+		struct alarm_entry *top = heap_top(heap_of(c, true));
+		struct alarm_entry *lazy_top = heap_top(heap_of(c, false));
+
+		memset(&expiry[c], 0, sizeof(expiry[c]));
+		memset(&lazy[c], 0, sizeof(lazy[c]));
+
+		if (top)
+		{
+			expiry[c] = top->latest;
+		}
+
+		if (lazy_top)
+		{
+			lazy[c] = lazy_top->latest;
+		}
+	}
+
+	wakeup_program_lazy(lazy);
+
+	return wakeup_program(expiry);
+}
+
+static void
+alarm_queue_wakeup(AlarmClock clock)
+{
+	alarm_queue_fire();
+}
+
+static void
+restore_placeholder(int slot, AlarmClock clock, const struct timespec *earliest,
+                    const struct timespec *latest, void *data)
+{
+	struct alarm_entry *entry;
+	struct timespec now;
+
+	wakeup_clock_now(clock, &now);
+
+	/* whatever expired while nobody was around has been missed already */
+	if (timespec_compare(latest, &now) <= 0 ||
+	    (entry = calloc(1, sizeof(struct alarm_entry))) == NULL)
+	{
+		alarm_journal_remove(slot);
+		return;
+	}
+
+	entry->id = next_id++;
+	entry->clock = clock;
+	entry->earliest = *earliest;
+	entry->latest = *latest;
+	entry->requested_latest = *latest;
+	entry->journal_slot = slot;
+	entry->placeholder = true;
+	entry->wakeup = true;
+
+	if (!heap_push(heap_of(clock, true), entry))
+	{
+		entry_free(entry);
+		return;
+	}
+
+	(*(guint *)data)++;
+}
+
+static gboolean
+drop_placeholders(gpointer data)
+{
+	guint h, i;
+	guint dropped = 0;
+
+	dispatch_lock();
+	placeholder_timeout = 0;
+
+	for (h = 0; h < HEAP_COUNT; h++)
+	{
+		for (i = 0; i < heaps[h].len;)
+		{
+			struct alarm_entry *entry = heaps[h].entries[i];
+
+			if (!entry->placeholder)
+			{
+				i++;
+				continue;
+			}
+
+			heap_delete(&heaps[h], entry);
+			entry_free(entry);
+			dropped++;
+			/* deleting reorders the heap, so scan it again */
+			i = 0;
+		}
+	}
+
+	if (dropped)
+	{
+		g_debug("%s: dropped %u unclaimed journal alarms", __FUNCTION__, dropped);
+		alarm_queue_rearm();
+	}
+
+	dispatch_unlock();
+
+	return FALSE;
+}
+
+/**
+* @brief Load the alarms journalled by a previous instance as
+* placeholders and arm the wakeup once for all of them.
+*/
+
+static void
+alarm_queue_restore(void)
+{
+	guint restored = 0;
+	long grace = config_get_int("ALARM_JOURNAL_GRACE", 60);
+
+	alarm_journal_foreach(restore_placeholder, &restored);
+
+	if (restored == 0)
+	{
+		return;
+	}
+
+	g_debug("%s: restored %u alarms from the journal", __FUNCTION__, restored);
+	alarm_queue_rearm();
+
+	if (grace > 0)
+	{
+		placeholder_timeout = g_timeout_add_seconds(grace, drop_placeholders, NULL);
+	}
+}
+
+static void
+fire_event(void *data)
+{
+	uint64_t count;
+
+	if (read(fire_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+	{
+		g_warning("%s: read failed %d", __FUNCTION__, errno);
+	}
+
+	alarm_queue_fire();
+}
+
+static bool
+fire_watch_open(void)
+{
+	fire_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (fire_fd < 0)
+	{
+		g_warning("%s: eventfd failed %d", __FUNCTION__, errno);
+		return false;
+	}
+
+	fire_watch = dispatch_add_watch(fire_fd, fire_event, NULL);
+
+	if (!fire_watch)
+	{
+		close(fire_fd);
+		fire_fd = -1;
+		return false;
+	}
+
+	return true;
+}
+
+static void
+fire_watch_close(void)
+{
+	dispatch_remove_watch(fire_watch);
+	fire_watch = NULL;
+
+	if (fire_fd >= 0)
+	{
+		close(fire_fd);
+		fire_fd = -1;
+	}
+}
+
+bool
+alarm_queue_init(nyx_device_handle_t handle)
+{
+	const char *journal = config_get_string("ALARM_JOURNAL", NULL);
+	bool ret = false;
+
+	dispatch_lock();
+	queue_handle = handle;
+
+	if (fire_watch_open())
+	{
+		if (wakeup_open(alarm_queue_wakeup))
+		{
+			if (journal && *journal && alarm_journal_open(journal))
+			{
+				alarm_queue_restore();
+			}
+
+			ret = true;
+		}
+		else
+		{
+			fire_watch_close();
+		}
+	}
+
+	dispatch_unlock();
+
+	return ret;
+}
+
+void
+alarm_queue_release(void)
+{
+	guint h, i;
+
+	dispatch_lock();
+
+	if (placeholder_timeout)
+	{
+		g_source_remove(placeholder_timeout);
+		placeholder_timeout = 0;
+	}
+
+	/* the journal is left as it is so a restart picks the alarms up */
+	for (h = 0; h < HEAP_COUNT; h++)
+	{
+		for (i = 0; i < heaps[h].len; i++)
+		{
+			free(heaps[h].entries[i]);
+		}
+
+		free(heaps[h].entries);
+		memset(&heaps[h], 0, sizeof(heaps[h]));
+	}
+
+	alarm_journal_close();
+	wakeup_close();
+	fire_watch_close();
+	queue_handle = NULL;
+	dispatch_unlock();
+}
+
+/**
+* @brief Key alarms without a callback by their id in the quota table,
+* they are not one client.
+*/
+
+static inline void *
+quota_context(const struct alarm_entry *entry)
+{
+	return entry->func ? entry->context : GUINT_TO_POINTER(entry->id);
+}
+
+/**
+* @brief Push latest out if the client has used up its wakeup quota, so
+* its alarm waits for another wakeup or for the quota to refill.
+*
+* @retval true if it was pushed out
+*/
+
+static bool
+quota_defer(AlarmClock clock, nyx_device_callback_function_t func,
+            void *context, struct timespec *latest)
+{
+	struct timespec now, boot;
+	int64_t delay;
+
+	if (!func)
+	{
+		return false;
+	}
+
+	wakeup_clock_now(clock, &now);
+	wakeup_clock_now(ALARM_CLOCK_BOOTTIME, &boot);
+	delay = alarm_quota_defer(func, context, timespec_to_ns(&boot),
+	                          timespec_to_ns(latest) - timespec_to_ns(&now));
+
+	if (delay > 0)
+	{
+		g_debug("%s: client %p/%p over quota, deadline moved by %" G_GINT64_FORMAT "ms",
+		        __FUNCTION__, (void *)func, context, delay / 1000000);
+		*latest = timespec_from_ns(timespec_to_ns(latest) + delay);
+	}
+
+	return delay > 0;
+}
+
+/**
+* @brief Take back the deferral quota_defer() counted for a request that
+* then failed.
+*/
+
+static void
+quota_undefer(nyx_device_callback_function_t func, void *context)
+{
+	struct timespec boot;
+
+	wakeup_clock_now(ALARM_CLOCK_BOOTTIME, &boot);
+	alarm_quota_undefer(func, context, timespec_to_ns(&boot));
+}
+
+/**
+* @brief Queue a new alarm that may fire anywhere in [earliest, latest],
+* both given as absolute times on the selected clock.
+*
+* @retval id of the new alarm, 0 on failure
+*/
+
+static guint
+queue_add_range(AlarmClock clock, const struct timespec *earliest,
+                const struct timespec *latest, bool wakeup,
+                nyx_device_callback_function_t func, void *context)
+{
+	struct alarm_entry *entry;
+	struct timespec due = *latest;
+	bool deferred = false;
+
+	g_return_val_if_fail(clock < ALARM_CLOCK_COUNT, 0);
+	g_return_val_if_fail(timespec_compare(earliest, latest) <= 0, 0);
+
+	/* the journal kept the window as requested, before any deferral */
+	entry = wakeup ? find_placeholder(clock, earliest, latest) : NULL;
+
+	if (entry)
+	{
+		/* the wakeup for this window is armed already */
+		entry->func = func;
+		entry->context = context;
+		entry->placeholder = false;
+		return entry->id;
+	}
+
+	if (wakeup)
+	{
+		deferred = quota_defer(clock, func, context, &due);
+	}
+
+	entry = calloc(1, sizeof(struct alarm_entry));
+
+	if (!entry)
+	{
+		goto undefer;
+	}
+
+	entry->id = next_id++;
+	entry->clock = clock;
+	entry->earliest = *earliest;
+	entry->latest = due;
+	entry->requested_latest = *latest;
+	entry->func = func;
+	entry->context = context;
+	entry->journal_slot = -1;
+	entry->wakeup = wakeup;
+
+	if (next_id == 0)
+	{
+		next_id = 1;
+	}
+
+	if (!heap_push(entry_heap(entry), entry))
+	{
+		free(entry);
+		goto undefer;
+	}
+
+	if (!alarm_queue_rearm())
+	{
+		heap_delete(entry_heap(entry), entry);
+		free(entry);
+		alarm_queue_rearm();
+		goto undefer;
+	}
+
+	entry_journal(entry);
+
+	return entry->id;
+undefer:
+
+	if (deferred)
+	{
+		quota_undefer(func, context);
+	}
+
+	return 0;
+}
+
+guint
+alarm_queue_add_range(AlarmClock clock, const struct timespec *earliest,
+                      const struct timespec *latest,
+                      nyx_device_callback_function_t func, void *context)
+{
+	guint id;
+
+	g_return_val_if_fail(clock < ALARM_CLOCK_COUNT, 0);
+
+	dispatch_lock();
+	id = queue_add_range(clock, earliest, latest, true, func, context);
+	dispatch_unlock();
+
+	return id;
+}
+
+guint
+alarm_queue_add(AlarmClock clock, const struct timespec *expiry,
+                nyx_device_callback_function_t func, void *context)
+{
+	return alarm_queue_add_range(clock, expiry, expiry, func, context);
+}
+
+/**
+* @brief Reposition an entry whose times changed, moving it to the other
+* heap if its wakeup class changes.
+*
+* @retval false if it could not be added to the other heap, it is then in
+* neither
+*/
+
+static bool
+entry_move(struct alarm_entry *entry, bool wakeup)
+{
+	if (entry->wakeup == wakeup)
+	{
+		heap_update(entry_heap(entry), entry);
+		return true;
+	}
+
+	heap_delete(entry_heap(entry), entry);
+	entry->wakeup = wakeup;
+
+	return heap_push(entry_heap(entry), entry);
+}
+
+/**
+* @brief Queue or move the alarm owned by the given callback/context pair
+* on the selected clock.
+*
+* This keeps the one-alarm-per-client semantics of system_set_alarm()
+* while letting several clients have an alarm pending at the same time.
+*
+* @param wakeup whether the alarm may wake the device; a client's alarm
+* moves between the classes when this changes
+*
+* @retval id of the alarm, 0 on failure
+*/
+
+static guint
+queue_set_range(AlarmClock clock, const struct timespec *earliest,
+                const struct timespec *latest, bool wakeup,
+                nyx_device_callback_function_t func, void *context)
+{
+	struct alarm_entry *entry, prev;
+	struct timespec due = *latest;
+	bool deferred = false;
+
+	g_return_val_if_fail(clock < ALARM_CLOCK_COUNT, 0);
+	g_return_val_if_fail(timespec_compare(earliest, latest) <= 0, 0);
+
+	entry = find_by_client(clock, func, context);
+
+	if (!entry)
+	{
+		/* a periodic alarm running its callback is replaced as well */
+		cancel_in_flight(0, clock, func, context);
+		return queue_add_range(clock, earliest, latest, wakeup, func, context);
+	}
+
+	if (wakeup)
+	{
+		deferred = quota_defer(clock, func, context, &due);
+	}
+
+	prev = *entry;
+	entry->earliest = *earliest;
+	entry->latest = due;
+	entry->requested_latest = *latest;
+	entry->interval_ns = 0;
+
+	if (!entry_move(entry, wakeup))
+	{
+		entry_free(entry);
+		alarm_queue_rearm();
+		goto undefer;
+	}
+
+	if (!alarm_queue_rearm())
+	{
+		/* keep the alarm as it was rather than unarmed */
+		entry->earliest = prev.earliest;
+		entry->latest = prev.latest;
+		entry->requested_latest = prev.requested_latest;
+		entry->interval_ns = prev.interval_ns;
+
+		if (!entry_move(entry, prev.wakeup))
+		{
+			entry_free(entry);
+		}
+
+		alarm_queue_rearm();
+		goto undefer;
+	}
+
+	entry_journal(entry);
+
+	return entry->id;
+undefer:
+
+	if (deferred)
+	{
+		quota_undefer(func, context);
+	}
+
+	return 0;
+}
+
+guint
+alarm_queue_set_range(AlarmClock clock, const struct timespec *earliest,
+                      const struct timespec *latest,
+                      nyx_device_callback_function_t func, void *context)
+{
+	guint id;
+
+	dispatch_lock();
+	id = queue_set_range(clock, earliest, latest, true, func, context);
+	dispatch_unlock();
+
+	return id;
+}
+
+guint
+alarm_queue_set(AlarmClock clock, const struct timespec *expiry,
+                nyx_device_callback_function_t func, void *context)
+{
+	return alarm_queue_set_range(clock, expiry, expiry, func, context);
+}
+
+/**
+* @brief Queue or move the client's alarm as a non-wakeup alarm.
+*
+* It never arms the wakeup source: while the device is awake it fires
+* around latest, during suspend it waits for the next wakeup or resume.
+*
+* @retval id of the alarm, 0 on failure
+*/
+
+guint
+alarm_queue_set_nonwakeup(AlarmClock clock, const struct timespec *earliest,
+                          const struct timespec *latest,
+                          nyx_device_callback_function_t func, void *context)
+{
+	guint id;
+
+	dispatch_lock();
+	id = queue_set_range(clock, earliest, latest, false, func, context);
+	dispatch_unlock();
+
+	return id;
+}
+
+/**
+* @brief Queue or move the client's alarm to expire at first and then
+* every interval after it, until it is cancelled.
+*
+* @param aligned keep every expiry at first + n * interval, skipping
+* periods that were missed; otherwise the next period starts when the
+* callback runs
+*
+* @retval id of the alarm, 0 on failure
+*/
+
+static guint
+queue_set_periodic(AlarmClock clock, const struct timespec *first,
+                   const struct timespec *interval, bool aligned,
+                   nyx_device_callback_function_t func, void *context)
+{
+	struct alarm_entry *entry;
+	guint id;
+
+	g_return_val_if_fail(timespec_to_ns(interval) > 0, 0);
+
+	id = queue_set_range(clock, first, first, true, func, context);
+	entry = id ? find_by_id(id) : NULL;
+
+	if (entry)
+	{
+		entry->interval_ns = timespec_to_ns(interval);
+		entry->aligned = aligned;
+	}
+
+	return id;
+}
+
+guint
+alarm_queue_set_periodic(AlarmClock clock, const struct timespec *first,
+                         const struct timespec *interval, bool aligned,
+                         nyx_device_callback_function_t func, void *context)
+{
+	guint id;
+
+	dispatch_lock();
+	id = queue_set_periodic(clock, first, interval, aligned, func, context);
+	dispatch_unlock();
+
+	return id;
+}
+
+static bool
+queue_remove(guint id)
+{
+	struct alarm_entry *entry = find_by_id(id);
+
+	if (!entry)
+	{
+		return cancel_in_flight(id, 0, NULL, NULL);
+	}
+
+	heap_delete(entry_heap(entry), entry);
+	entry_free(entry);
+
+	return alarm_queue_rearm();
+}
+
+bool
+alarm_queue_remove(guint id)
+{
+	bool ret;
+
+	dispatch_lock();
+	ret = queue_remove(id);
+	dispatch_unlock();
+
+	return ret;
+}
+
+static bool
+queue_cancel(AlarmClock clock, nyx_device_callback_function_t func,
+             void *context)
+{
+	struct alarm_entry *entry;
+
+	g_return_val_if_fail(clock < ALARM_CLOCK_COUNT, false);
+
+	entry = find_by_client(clock, func, context);
+
+	if (!entry)
+	{
+		cancel_in_flight(0, clock, func, context);
+		return true;
+	}
+
+	return queue_remove(entry->id);
+}
+
+bool
+alarm_queue_cancel(AlarmClock clock, nyx_device_callback_function_t func,
+                   void *context)
+{
+	bool ret;
+
+	dispatch_lock();
+	ret = queue_cancel(clock, func, context);
+	dispatch_unlock();
+
+	return ret;
+}
+
+/**
+* @brief Time the given clock is armed for, i.e. its smallest latest
+* expiry. Non-wakeup alarms are not taken into account.
+*
+* @retval false if no alarm is pending on that clock
+*/
+
+static bool
+queue_next(AlarmClock clock, struct timespec *expiry)
+{
+	struct alarm_entry *top;
+
+	g_return_val_if_fail(clock < ALARM_CLOCK_COUNT, false);
+
+	top = heap_top(heap_of(clock, true));
+
+	if (!top)
+	{
+		return false;
+	}
+
+	if (expiry)
+	{
+		*expiry = top->latest;
+	}
+
+	return true;
+}
+
+bool
+alarm_queue_next(AlarmClock clock, struct timespec *expiry)
+{
+	bool ret;
+
+	dispatch_lock();
+	ret = queue_next(clock, expiry);
+	dispatch_unlock();
+
+	return ret;
+}
+
+/**
+* @brief Defer re-arming the hardware until the matching
+* alarm_queue_unhold(), so a batch of changes is programmed once.
+*/
+
+void
+alarm_queue_hold(void)
+{
+	dispatch_lock();
+	held++;
+	dispatch_unlock();
+}
+
+/**
+* @retval false if re-arming the batch failed
+*/
+
+bool
+alarm_queue_unhold(void)
+{
+	bool ret = true;
+
+	dispatch_lock();
+
+	if (held > 0 && --held == 0)
+	{
+		ret = alarm_queue_rearm();
+	}
+
+	dispatch_unlock();
+
+	return ret;
+}
+
+/**
+* @brief Earliest pending wakeup alarm of any clock, as wall time.
+*
+* @retval false if no alarm is pending
+*/
+
+bool
+alarm_queue_next_wall(struct timespec *wall)
+{
+	bool found = false;
+	guint c;
+
+	dispatch_lock();
+
+	for (c = 0; c < ALARM_CLOCK_COUNT; c++)
+	{
+		struct alarm_entry *top = heap_top(heap_of(c, true));
+		struct timespec converted;
+
+		if (!top)
+		{
+			continue;
+		}
+
+		wakeup_to_wall(c, &top->latest, &converted);
+
+		if (!found || timespec_compare(&converted, wall) < 0)
+		{
+			*wall = converted;
+			found = true;
+		}
+	}
+
+	dispatch_unlock();
+
+	return found;
+}
+
+guint
+alarm_queue_length(void)
+{
+	guint h, len = 0;
+
+	dispatch_lock();
+
+	for (h = 0; h < HEAP_COUNT; h++)
+	{
+		len += heaps[h].len;
+	}
+
+	dispatch_unlock();
+
+	return len;
+}
+
+/**
+* @brief Number of hardware wakeups avoided by coalescing alarm windows.
+*/
+
+guint
+alarm_queue_saved_wakeups(void)
+{
+	guint count;
+
+	dispatch_lock();
+	count = saved_wakeups;
+	dispatch_unlock();
+
+	return count;
+}
+
+/**
+* @brief Move a periodic alarm to its next period and put it back.
+*/
+
+static void
+requeue_periodic(struct alarm_entry *entry)
+{
+	struct timespec now;
+	int64_t latest = timespec_to_ns(&entry->latest);
+	int64_t shift;
+
+	wakeup_clock_now(entry->clock, &now);
+
+	if (entry->aligned)
+	{
+		int64_t missed = MAX(timespec_to_ns(&now) - latest, 0) / entry->interval_ns;
+
+		shift = (missed + 1) * entry->interval_ns;
+	}
+	else
+	{
+		shift = timespec_to_ns(&now) + entry->interval_ns - latest;
+	}
+
+	entry->earliest = timespec_from_ns(timespec_to_ns(&entry->earliest) + shift);
+	entry->latest = timespec_from_ns(latest + shift);
+	entry->requested_latest = entry->latest;
+
+	if (!heap_push(entry_heap(entry), entry))
+	{
+		g_warning("%s: dropping periodic alarm %u", __FUNCTION__, entry->id);
+		entry_free(entry);
+		return;
+	}
+
+	entry_journal(entry);
+}
+
+/**
+* @brief Have func called once per fire pass with the ids of every alarm
+* delivered in it, NULL to stop. Alarms added without a callback of their
+* own are only ever reported this way.
+*/
+
+void
+alarm_queue_set_batch_func(AlarmBatchFunc func, void *data)
+{
+	dispatch_lock();
+	batch_func = func;
+	batch_data = data;
+	dispatch_unlock();
+}
+
+/**
+* @brief Called when an armed wakeup fires.
+*
+* Pops every alarm whose window has opened on either clock, runs its
+* callback and re-arms the hardware once for whatever is left. Expired
+* non-wakeup alarms are delivered along with them. The batch function,
+* if any, then gets the ids of all of them in a single call.
+* Callbacks may add or remove alarms; re-arming is deferred until all
+* of them have run. Callbacks run with the dispatch lock held, on the
+* dispatch thread when one is used.
+*/
+
+void
+alarm_queue_fire(void)
+{
+	struct alarm_entry **fired = NULL;
+	struct alarm_entry *last_wakeup = NULL;
+	guint *ids = NULL;
+	guint nids = 0;
+	guint nbatch_only = 0;
+	int64_t event_ns = 0;
+	uint64_t event_syscalls = 0;
+	bool from_event;
+	guint nfired = 0;
+	guint deadlines = 0;
+	guint total;
+	guint h, i;
+
+	dispatch_lock();
+	/* only passes started by a wakeup fd event tell about the fire path */
+	from_event = dispatch_event_start(&event_ns, &event_syscalls);
+	total = alarm_queue_length();
+
+	if (total > 0)
+	{
+		fired = calloc(total, sizeof(*fired));
+		ids = batch_func ? calloc(total, sizeof(*ids)) : NULL;
+	}
+
+	for (h = 0; fired && h < HEAP_COUNT; h++)
+	{
+		struct alarm_heap *heap = &heaps[h];
+		struct timespec now;
+
+		if (heap->len == 0)
+		{
+			continue;
+		}
+
+		wakeup_clock_now(heap_clock(h), &now);
+
+		/* a wakeup moved earlier for RTC drift is there for these */
+		if (heap == heap_of(heap_clock(h), true))
+		{
+			now = timespec_from_ns(timespec_to_ns(&now) +
+			                       wakeup_drift_slack(heap_clock(h)));
+		}
+
+		for (i = 0; i < heap->len; i++)
+		{
+			if (timespec_compare(&heap->entries[i]->earliest, &now) <= 0)
+			{
+				fired[nfired++] = heap->entries[i];
+			}
+		}
+	}
+
+	for (i = 0; i < nfired; i++)
+	{
+		heap_delete(entry_heap(fired[i]), fired[i]);
+	}
+
+	if (nfired > 1)
+	{
+		qsort(fired, nfired, sizeof(*fired), compare_deadline);
+	}
+
+	dispatching = true;
+	in_flight = fired;
+	in_flight_len = nfired;
+
+	for (i = 0; i < nfired; i++)
+	{
+		/* non-wakeup alarms never needed a wakeup of their own */
+		if (fired[i]->wakeup)
+		{
+			/* the earliest deadline that has passed is what woke us,
+			 * the rest was coalesced into it */
+			if (!last_wakeup && !fired[i]->placeholder)
+			{
+				struct timespec now, boot;
+
+				wakeup_clock_now(fired[i]->clock, &now);
+				wakeup_clock_now(ALARM_CLOCK_BOOTTIME, &boot);
+
+				if (timespec_compare(&fired[i]->latest, &now) <= 0)
+				{
+					alarm_quota_charge(fired[i]->func, quota_context(fired[i]),
+					                   timespec_to_ns(&boot));
+				}
+			}
+
+			if (!last_wakeup || compare_deadline(&last_wakeup, &fired[i]) != 0)
+			{
+				deadlines++;
+			}
+
+			last_wakeup = fired[i];
+		}
+
+		if (fired[i]->func || (ids && !fired[i]->placeholder))
+		{
+			struct timespec now;
+
+			wakeup_clock_now(fired[i]->clock, &now);
+			latency_stats_record(fired[i]->wakeup ? wakeup_backend_name() : NULL,
+			                     fired[i]->func,
+			                     fired[i]->context,
+			                     timespec_to_ns(&now) - timespec_to_ns(&fired[i]->latest));
+		}
+
+		if (ids && !fired[i]->placeholder)
+		{
+			ids[nids++] = fired[i]->id;
+			nbatch_only += !fired[i]->func;
+		}
+
+		if (fired[i]->func)
+		{
+			if (from_event)
+			{
+				struct timespec mono;
+
+				clock_gettime(CLOCK_MONOTONIC, &mono);
+				latency_stats_fire_path(timespec_to_ns(&mono) - event_ns);
+			}
+
+			fired[i]->func(queue_handle, NYX_CALLBACK_STATUS_DONE, fired[i]->context);
+		}
+	}
+
+	if (nids > 0 && batch_func)
+	{
+		/* alarms without a callback reach their client only here */
+		if (from_event)
+		{
+			struct timespec mono;
+
+			clock_gettime(CLOCK_MONOTONIC, &mono);
+
+			for (i = 0; i < nbatch_only; i++)
+			{
+				latency_stats_fire_path(timespec_to_ns(&mono) - event_ns);
+			}
+		}
+
+		batch_func(queue_handle, ids, nids, batch_data);
+	}
+
+	dispatching = false;
+	in_flight = NULL;
+	in_flight_len = 0;
+
+	for (i = 0; i < nfired; i++)
+	{
+		if (fired[i]->interval_ns && !fired[i]->cancelled)
+		{
+			requeue_periodic(fired[i]);
+		}
+		else
+		{
+			entry_free(fired[i]);
+		}
+	}
+
+	free(fired);
+	free(ids);
+
+	/* Every distinct deadline delivered beyond the first one would have
+	 * needed its own wakeup without coalescing. */
+	if (deadlines > 1)
+	{
+		saved_wakeups += deadlines - 1;
+		g_debug("%s: coalesced %u alarms, %u wakeups saved", __FUNCTION__,
+		        nfired, deadlines - 1);
+	}
+
+	alarm_queue_rearm();
+
+	if (from_event && nfired > 0)
+	{
+		latency_stats_fire_pass(syscall_stats_total() - event_syscalls);
+	}
+
+	dispatch_unlock();
+}
+
+/**
+* @brief Have alarm_queue_fire() run where wakeup events are handled,
+* the main loop or the dispatch thread, rather than on the calling
+* thread. Safe to call from any thread.
+*/
+
+void
+alarm_queue_fire_async(void)
+{
+	uint64_t one = 1;
+
+	if (fire_fd >= 0 && write(fire_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+	{
+		g_warning("%s: could not signal a fire pass %d", __FUNCTION__, errno);
+	}
+}
+
+/* @} END OF RTCAlarms */
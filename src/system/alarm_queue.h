@@ -0,0 +1,68 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************
+* @file alarm_queue.h
+*******************************************
+*/
+
+#ifndef _ALARM_QUEUE_H_
+#define _ALARM_QUEUE_H_
+
+#include <stdbool.h>
+#include <time.h>
+#include <glib.h>
+#include <nyx/nyx_module.h>
+#include "wakeup.h"
+
+typedef void (*AlarmBatchFunc)(nyx_device_handle_t handle, const guint *ids,
+                               guint count, void *data);
+
+bool alarm_queue_init(nyx_device_handle_t handle);
+void alarm_queue_release(void);
+guint alarm_queue_add(AlarmClock clock, const struct timespec *expiry,
+                      nyx_device_callback_function_t func, void *context);
+guint alarm_queue_add_range(AlarmClock clock, const struct timespec *earliest,
+                            const struct timespec *latest,
+                            nyx_device_callback_function_t func, void *context);
+guint alarm_queue_set(AlarmClock clock, const struct timespec *expiry,
+                      nyx_device_callback_function_t func, void *context);
+guint alarm_queue_set_range(AlarmClock clock, const struct timespec *earliest,
+                            const struct timespec *latest,
+                            nyx_device_callback_function_t func, void *context);
+guint alarm_queue_set_nonwakeup(AlarmClock clock, const struct timespec *earliest,
+                                const struct timespec *latest,
+                                nyx_device_callback_function_t func, void *context);
+guint alarm_queue_set_periodic(AlarmClock clock, const struct timespec *first,
+                               const struct timespec *interval, bool aligned,
+                               nyx_device_callback_function_t func, void *context);
+bool alarm_queue_remove(guint id);
+bool alarm_queue_cancel(AlarmClock clock, nyx_device_callback_function_t func,
+                        void *context);
+bool alarm_queue_next(AlarmClock clock, struct timespec *expiry);
+bool alarm_queue_next_wall(struct timespec *wall);
+void alarm_queue_hold(void);
+bool alarm_queue_unhold(void);
+guint alarm_queue_length(void);
+guint alarm_queue_saved_wakeups(void);
+void alarm_queue_set_batch_func(AlarmBatchFunc func, void *data);
+void alarm_queue_fire(void);
+void alarm_queue_fire_async(void);
+
+#endif
@@ -0,0 +1,383 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************************************
+* @file alarm_quota.c
+*
+* @brief Per-client wakeup accounting and quotas. Every wakeup is
+* charged to the client whose alarm deadline caused it. With a quota
+* configured each client has a token bucket of burst wakeups, refilled
+* by one every period. A client that has used up its tokens gets the
+* deadline of its next wakeup alarm pushed out to when a token is
+* available again; the alarm still fires earlier if another wakeup
+* opens its window first.
+*
+* The table is small. When it is full, a client with a full bucket makes
+* room, as it has nothing left to be held to: the one that caused the
+* fewest wakeups, so the clients worth reporting keep their entries.
+* Its counts move to the overflow entry so no wakeup goes unreported.
+* If every client still owes wakeups, a new client shares one overflow
+* bucket with the others that found no room, so none of them gets past
+* the quota.
+*******************************************************************
+*/
+
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <glib.h>
+#include <nyx/nyx_module.h>
+#include "alarm_quota.h"
+
+#define QUOTA_CLIENTS 32
+/* keep burst * period_ns well within int64_t */
+#define QUOTA_MAX_BURST 1000
+#define QUOTA_MAX_PERIOD (24 * 60 * 60)
+
+struct client_quota
+{
+	nyx_device_callback_function_t func;
+	void *context;
+	/* bucket level in ns of refill time, one wakeup costs period_ns */
+	int64_t credit_ns;
+	int64_t updated_ns;
+	int64_t seen_ns;
+	uint64_t wakeups;
+	uint64_t deferred;
+};
+
+static struct client_quota clients[QUOTA_CLIENTS];
+static guint nclients = 0;
+/* clients that found the table full or were evicted from it, reported
+ * as a NULL callback */
+static struct client_quota overflow;
+static bool clients_full_logged = false;
+
+static unsigned int burst = 0;
+static int64_t period_ns = 0;
+
+/**
+* @brief Set the quota, a burst of 0 turns it off. Wakeups are accounted
+* for either way.
+*
+* @param max_burst wakeups in a row, a negative one turns the quota off
+* and a larger one than QUOTA_MAX_BURST is clamped
+* @param period_s seconds it takes to earn one wakeup back, clamped to
+* QUOTA_MAX_PERIOD
+*/
+
+void
+alarm_quota_configure(long max_burst, long period_s)
+{
+	if (max_burst < 0 || max_burst > QUOTA_MAX_BURST)
+	{
+		g_warning("%s: burst %ld out of range, using %d", __FUNCTION__, max_burst,
+		          max_burst < 0 ? 0 : QUOTA_MAX_BURST);
+		max_burst = CLAMP(max_burst, 0, QUOTA_MAX_BURST);
+	}
+
+	if (period_s > QUOTA_MAX_PERIOD)
+	{
+		g_warning("%s: period %lds out of range, using %ds", __FUNCTION__, period_s,
+		          QUOTA_MAX_PERIOD);
+		period_s = QUOTA_MAX_PERIOD;
+	}
+
+	burst = period_s > 0 ? (unsigned int)max_burst : 0;
+	period_ns = (int64_t)MAX(period_s, 0) * 1000000000LL;
+	overflow.credit_ns = burst * period_ns;
+
+	if (burst)
+	{
+		g_message("Alarm quota: %u wakeups, one more every %lds", burst, period_s);
+	}
+}
+
+static void
+refill(struct client_quota *c, int64_t now_ns)
+{
+	if (now_ns > c->updated_ns)
+	{
+		c->credit_ns = MIN(c->credit_ns + (now_ns - c->updated_ns),
+		                   burst * period_ns);
+	}
+
+	c->updated_ns = now_ns;
+}
+
+/**
+* @brief The client with a full bucket that caused the fewest wakeups,
+* the least recently seen of those, NULL if every client still owes
+* wakeups.
+*/
+
+static struct client_quota *
+find_idle(int64_t now_ns)
+{
+	struct client_quota *idle = NULL;
+	guint i;
+
+	for (i = 0; i < nclients; i++)
+	{
+		if (burst)
+		{
+			refill(&clients[i], now_ns);
+		}
+
+		if (clients[i].credit_ns >= burst * period_ns &&
+		    (!idle || clients[i].wakeups < idle->wakeups ||
+		     (clients[i].wakeups == idle->wakeups &&
+		      clients[i].seen_ns < idle->seen_ns)))
+		{
+			idle = &clients[i];
+		}
+	}
+
+	return idle;
+}
+
+/**
+* @brief The client's entry, or with create a new one, which when the
+* table is full is an idle entry taken over or the overflow bucket.
+*/
+
+static struct client_quota *
+find_client(nyx_device_callback_function_t func, void *context, int64_t now_ns,
+            bool create)
+{
+	struct client_quota *c = NULL;
+	guint i;
+
+	for (i = 0; i < nclients; i++)
+	{
+		if (clients[i].func == func && clients[i].context == context)
+		{
+			clients[i].seen_ns = now_ns;
+			return &clients[i];
+		}
+	}
+
+	if (nclients < QUOTA_CLIENTS)
+	{
+		if (create)
+		{
+			c = &clients[nclients++];
+		}
+	}
+	else if ((c = find_idle(now_ns)))
+	{
+		if (!create)
+		{
+			/* it would start out with a full bucket as well */
+			return NULL;
+		}
+
+		/* only the quota state is recycled, the counts are kept */
+		overflow.wakeups += c->wakeups;
+		overflow.deferred += c->deferred;
+	}
+	else
+	{
+		if (!clients_full_logged)
+		{
+			g_debug("%s: client table full, sharing the overflow bucket",
+			        __FUNCTION__);
+			clients_full_logged = true;
+		}
+
+		overflow.seen_ns = now_ns;
+		return &overflow;
+	}
+
+	if (!c)
+	{
+		return NULL;
+	}
+
+	memset(c, 0, sizeof(*c));
+	c->func = func;
+	c->context = context;
+	c->credit_ns = burst * period_ns;
+	c->updated_ns = now_ns;
+	c->seen_ns = now_ns;
+
+	return c;
+}
+
+/**
+* @brief Charge one wakeup to the client.
+*
+* @param now_ns current boot clock time
+*/
+
+void
+alarm_quota_charge(nyx_device_callback_function_t func, void *context,
+                   int64_t now_ns)
+{
+	struct client_quota *c = find_client(func, context, now_ns, true);
+
+	if (!c)
+	{
+		return;
+	}
+
+	c->wakeups++;
+
+	if (burst)
+	{
+		refill(c, now_ns);
+		c->credit_ns = MAX(c->credit_ns - period_ns, 0);
+	}
+}
+
+/**
+* @brief How much later than requested a wakeup alarm of the client may
+* be due.
+*
+* @param now_ns current boot clock time
+* @param in_ns time from now until the requested deadline
+*
+* @retval ns to add to the deadline, 0 if the client is within its quota
+*/
+
+int64_t
+alarm_quota_defer(nyx_device_callback_function_t func, void *context,
+                  int64_t now_ns, int64_t in_ns)
+{
+	struct client_quota *c;
+	int64_t wait;
+
+	if (!burst || !(c = find_client(func, context, now_ns, false)))
+	{
+		return 0;
+	}
+
+	refill(c, now_ns);
+	wait = c->credit_ns >= period_ns ? 0 : period_ns - c->credit_ns;
+
+	if (wait <= in_ns)
+	{
+		return 0;
+	}
+
+	c->deferred++;
+
+	return wait - MAX(in_ns, 0);
+}
+
+/**
+* @brief Take back a deferral counted by alarm_quota_defer() for an alarm
+* that was then not queued after all.
+*/
+
+void
+alarm_quota_undefer(nyx_device_callback_function_t func, void *context,
+                    int64_t now_ns)
+{
+	struct client_quota *c;
+
+	if (!burst || !(c = find_client(func, context, now_ns, false)))
+	{
+		return;
+	}
+
+	if (c->deferred > 0)
+	{
+		c->deferred--;
+	}
+}
+
+static int
+compare_wakeups(const void *a, const void *b)
+{
+	const system_client_wakeups_t *x = a;
+	const system_client_wakeups_t *y = b;
+
+	return x->wakeups < y->wakeups ? 1 : x->wakeups > y->wakeups ? -1 : 0;
+}
+
+/**
+* @brief Fill out with up to max clients, the ones that caused the most
+* wakeups first.
+*
+* @retval number of entries filled in
+*/
+
+guint
+alarm_quota_top(system_client_wakeups_t *out, guint max)
+{
+	system_client_wakeups_t *all;
+	guint i, n, total = nclients;
+
+	if (nclients == 0 || max == 0)
+	{
+		return 0;
+	}
+
+	all = calloc(nclients + 1, sizeof(*all));
+
+	if (!all)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < nclients; i++)
+	{
+		all[i].callback = clients[i].func;
+		all[i].context = clients[i].context;
+		all[i].wakeups = clients[i].wakeups;
+		all[i].deferred = clients[i].deferred;
+	}
+
+	if (overflow.wakeups || overflow.deferred)
+	{
+		all[total].wakeups = overflow.wakeups;
+		all[total].deferred = overflow.deferred;
+		total++;
+	}
+
+	qsort(all, total, sizeof(*all), compare_wakeups);
+	n = MIN(max, total);
+	memcpy(out, all, n * sizeof(*all));
+	free(all);
+
+	return n;
+}
+
+void
+alarm_quota_dump(void)
+{
+	guint i;
+
+	for (i = 0; i < nclients; i++)
+	{
+		g_message("quota: client %p/%p wakeups %" G_GUINT64_FORMAT
+		          " deferred %" G_GUINT64_FORMAT, (void *)clients[i].func,
+		          clients[i].context, (guint64)clients[i].wakeups,
+		          (guint64)clients[i].deferred);
+	}
+
+	if (overflow.wakeups || overflow.deferred)
+	{
+		g_message("quota: overflow wakeups %" G_GUINT64_FORMAT " deferred %"
+		          G_GUINT64_FORMAT, (guint64)overflow.wakeups,
+		          (guint64)overflow.deferred);
+	}
+}
@@ -0,0 +1,43 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************
+* @file alarm_quota.h
+*******************************************
+*/
+
+#ifndef _ALARM_QUOTA_H_
+#define _ALARM_QUOTA_H_
+
+#include <stdint.h>
+#include <glib.h>
+#include <nyx/nyx_module.h>
+#include "system.h"
+
+void alarm_quota_configure(long max_burst, long period_s);
+void alarm_quota_charge(nyx_device_callback_function_t func, void *context,
+                        int64_t now_ns);
+int64_t alarm_quota_defer(nyx_device_callback_function_t func, void *context,
+                          int64_t now_ns, int64_t in_ns);
+void alarm_quota_undefer(nyx_device_callback_function_t func, void *context,
+                         int64_t now_ns);
+guint alarm_quota_top(system_client_wakeups_t *out, guint max);
+void alarm_quota_dump(void);
+
+#endif
@@ -0,0 +1,282 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+****************************************************************
+* @file alarm_submit.c
+*
+* @brief Asynchronous alarm requests.
+*
+* Callers push their request onto a lock-free list and return right
+* away; programming the hardware, which can block on a slow RTC bus,
+* happens on the dispatch thread. A batch of requests is applied under
+* one lock with a single re-arm, and only the newest request of each
+* client counts. Setters that do not go through here flush the list
+* first, so requests still take effect in the order they were made.
+***************************************************************
+*/
+
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdbool.h>
+#include <glib.h>
+#include <nyx/nyx_module.h>
+#include "alarm_queue.h"
+#include "alarm_submit.h"
+#include "dispatch.h"
+#include "timespec.h"
+
+/**
+ * @addtogroup RTCAlarms
+ * @{
+ */
+
+struct alarm_request
+{
+	AlarmClock clock;
+	struct timespec expiry;
+	nyx_device_callback_function_t func;
+	void *context;
+	struct alarm_request *next;
+};
+
+/* pushed by any thread, newest first */
+static struct alarm_request *pending = NULL;
+static int submit_fd = -1;
+static struct dispatch_watch *submit_watch = NULL;
+
+static guint
+client_hash(gconstpointer key)
+{
+	const struct alarm_request *req = key;
+
+	return g_direct_hash(req->func) ^ g_direct_hash(req->context) ^ req->clock;
+}
+
+static gboolean
+client_equal(gconstpointer a, gconstpointer b)
+{
+	const struct alarm_request *x = a;
+	const struct alarm_request *y = b;
+
+	return x->clock == y->clock && x->func == y->func && x->context == y->context;
+}
+
+static void
+free_requests(struct alarm_request *req)
+{
+	while (req)
+	{
+		struct alarm_request *next = req->next;
+
+		free(req);
+		req = next;
+	}
+}
+
+static void
+submit_apply(void)
+{
+	struct alarm_request *batch, *req;
+	GHashTable *seen;
+	guint applied = 0, dropped = 0, failed = 0;
+	bool ok;
+
+	batch = __atomic_exchange_n(&pending, NULL, __ATOMIC_ACQUIRE);
+
+	if (!batch)
+	{
+		return;
+	}
+
+	seen = g_hash_table_new(client_hash, client_equal);
+	alarm_queue_hold();
+
+	/* the list is newest first, so a client seen before has been
+	 * superseded already */
+	for (req = batch; req; req = req->next)
+	{
+		if (g_hash_table_lookup(seen, req))
+		{
+			dropped++;
+			continue;
+		}
+
+		g_hash_table_insert(seen, req, req);
+
+		if (timespec_is_set(&req->expiry))
+		{
+			ok = alarm_queue_set(req->clock, &req->expiry, req->func,
+			                     req->context) != 0;
+		}
+		else
+		{
+			ok = alarm_queue_cancel(req->clock, req->func, req->context);
+		}
+
+		if (!ok)
+		{
+			g_warning("%s: could not %s the alarm of client %p/%p", __FUNCTION__,
+			          timespec_is_set(&req->expiry) ? "set" : "cancel",
+			          (void *)req->func, req->context);
+			failed++;
+		}
+
+		applied++;
+	}
+
+	if (!alarm_queue_unhold())
+	{
+		g_warning("%s: could not arm the wakeup for %u requests", __FUNCTION__,
+		          applied);
+	}
+
+	g_hash_table_destroy(seen);
+	free_requests(batch);
+
+	if (dropped || failed)
+	{
+		g_debug("%s: applied %u requests, %u superseded, %u failed", __FUNCTION__,
+		        applied, dropped, failed);
+	}
+}
+
+static void
+submit_event(void *data)
+{
+	uint64_t count;
+
+	if (read(submit_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+	{
+		g_warning("%s: read failed %d", __FUNCTION__, errno);
+	}
+
+	submit_apply();
+}
+
+bool
+alarm_submit_init(void)
+{
+	if (submit_fd >= 0)
+	{
+		return true;
+	}
+
+	submit_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (submit_fd < 0)
+	{
+		g_warning("%s: eventfd failed %d", __FUNCTION__, errno);
+		return false;
+	}
+
+	submit_watch = dispatch_add_watch(submit_fd, submit_event, NULL);
+
+	if (!submit_watch)
+	{
+		alarm_submit_release();
+		return false;
+	}
+
+	return true;
+}
+
+/**
+* @brief Stop taking requests. Requests not applied yet are dropped.
+*/
+
+void
+alarm_submit_release(void)
+{
+	dispatch_remove_watch(submit_watch);
+	submit_watch = NULL;
+
+	if (submit_fd >= 0)
+	{
+		close(submit_fd);
+		submit_fd = -1;
+	}
+
+	free_requests(__atomic_exchange_n(&pending, NULL, __ATOMIC_ACQUIRE));
+}
+
+bool
+alarm_submit_enabled(void)
+{
+	return submit_watch != NULL;
+}
+
+/**
+* @brief Apply the requests not applied yet right here, so that a
+* request made synchronously afterwards is not overtaken by an older
+* one still queued.
+*/
+
+void
+alarm_submit_flush(void)
+{
+	if (!submit_watch)
+	{
+		return;
+	}
+
+	dispatch_lock();
+	submit_apply();
+	dispatch_unlock();
+}
+
+/**
+* @brief Queue setting, or with a zero expiry cancelling, the client's
+* alarm. Safe to call from any thread; returns without waiting for the
+* hardware.
+*/
+
+bool
+alarm_submit(AlarmClock clock, const struct timespec *expiry,
+             nyx_device_callback_function_t func, void *context)
+{
+	struct alarm_request *req = calloc(1, sizeof(struct alarm_request));
+	uint64_t one = 1;
+
+	if (!req)
+	{
+		return false;
+	}
+
+	req->clock = clock;
+	req->expiry = *expiry;
+	req->func = func;
+	req->context = context;
+	req->next = __atomic_load_n(&pending, __ATOMIC_RELAXED);
+
+	while (!__atomic_compare_exchange_n(&pending, &req->next, req, true,
+	                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	if (write(submit_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+	{
+		g_warning("%s: could not signal request %d", __FUNCTION__, errno);
+	}
+
+	return true;
+}
+
+/* @} END OF RTCAlarms */
@@ -0,0 +1,40 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************
+* @file alarm_submit.h
+*******************************************
+*/
+
+#ifndef _ALARM_SUBMIT_H_
+#define _ALARM_SUBMIT_H_
+
+#include <stdbool.h>
+#include <time.h>
+#include <nyx/nyx_module.h>
+#include "wakeup.h"
+
+bool alarm_submit_init(void);
+void alarm_submit_release(void);
+bool alarm_submit_enabled(void);
+void alarm_submit_flush(void);
+bool alarm_submit(AlarmClock clock, const struct timespec *expiry,
+                  nyx_device_callback_function_t func, void *context);
+
+#endif
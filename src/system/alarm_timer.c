@@ -0,0 +1,206 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+****************************************************************
+* @file alarm_timer.c
+*
+* @brief One-shot absolute timerfd timers watched through the
+* dispatcher. Used both as wakeup source (on the *_ALARM clocks) and to
+* notify us of expiry when the wakeup source itself cannot.
+***************************************************************
+*/
+
+#include <sys/timerfd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdbool.h>
+#include <glib.h>
+#include "alarm_timer.h"
+#include "dispatch.h"
+#include "syscall_stats.h"
+
+/**
+ * @addtogroup RTCAlarms
+ * @{
+ */
+
+static bool alarm_timer_arm_clock_watch(struct alarm_timer *timer);
+
+static void
+alarm_timer_event(void *ctx)
+{
+	struct alarm_timer *timer = (struct alarm_timer *)ctx;
+	uint64_t expirations;
+	ssize_t ret;
+
+	syscall_stats_inc(SYSCALL_TIMERFD_READ);
+	ret = read(timer->fd, &expirations, sizeof(expirations));
+
+	if (ret == sizeof(expirations))
+	{
+		timer->func(timer);
+	}
+	else if (ret < 0 && errno == ECANCELED && timer->clock_watch)
+	{
+		/* the clock was set, the timer has to be armed again to hear
+		 * about the next change */
+		alarm_timer_arm_clock_watch(timer);
+		timer->func(timer);
+	}
+}
+
+/**
+ * @brief Create a timer on the given clock and start watching it.
+ *
+ */
+bool
+alarm_timer_open(struct alarm_timer *timer, clockid_t clockid,
+                 AlarmTimerFunc func)
+{
+	if (timer->fd >= 0)
+	{
+		return true;
+	}
+
+	syscall_stats_inc(SYSCALL_DEV_OPEN);
+	timer->fd = timerfd_create(clockid, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if (timer->fd < 0)
+	{
+		return false;
+	}
+
+	timer->func = func;
+	timer->watch = dispatch_add_watch(timer->fd, alarm_timer_event, timer);
+
+	if (!timer->watch)
+	{
+		alarm_timer_close(timer);
+		return false;
+	}
+
+	return true;
+}
+
+void
+alarm_timer_close(struct alarm_timer *timer)
+{
+	if (timer->watch)
+	{
+		dispatch_remove_watch(timer->watch);
+		timer->watch = NULL;
+	}
+
+	if (timer->fd >= 0)
+	{
+		syscall_stats_inc(SYSCALL_DEV_CLOSE);
+		close(timer->fd);
+		timer->fd = -1;
+	}
+
+	timer->clock_watch = false;
+}
+
+/**
+* @brief Arm the timer for an absolute expiry on its clock.
+*
+* Expiries in the past fire immediately.
+*/
+
+bool
+alarm_timer_set(struct alarm_timer *timer, const struct timespec *expiry)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value = *expiry;
+
+	syscall_stats_inc(SYSCALL_TIMERFD_SETTIME);
+
+	if (timerfd_settime(timer->fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+	{
+		g_critical("Could not arm timer %d", errno);
+		return false;
+	}
+
+	return true;
+}
+
+bool
+alarm_timer_clear(struct alarm_timer *timer)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	syscall_stats_inc(SYSCALL_TIMERFD_SETTIME);
+
+	return timerfd_settime(timer->fd, 0, &its, NULL) == 0;
+}
+
+static bool
+alarm_timer_arm_clock_watch(struct alarm_timer *timer)
+{
+	struct itimerspec its;
+
+	/* never expires, it only exists to be cancelled */
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = ~((time_t)1 << (sizeof(time_t) * 8 - 1));
+
+	syscall_stats_inc(SYSCALL_TIMERFD_SETTIME);
+
+	if (timerfd_settime(timer->fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+	                    &its, NULL) < 0)
+	{
+		g_warning("Could not watch for clock changes %d", errno);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+* @brief Use the timer to get notified whenever the wall clock is set.
+*
+* func is called after every discontinuous change of CLOCK_REALTIME,
+* e.g. by settimeofday() or NTP stepping the clock.
+*/
+
+bool
+alarm_timer_watch_clock_set(struct alarm_timer *timer, AlarmTimerFunc func)
+{
+	if (!alarm_timer_open(timer, CLOCK_REALTIME, func))
+	{
+		return false;
+	}
+
+	timer->clock_watch = true;
+
+	if (!alarm_timer_arm_clock_watch(timer))
+	{
+		alarm_timer_close(timer);
+		return false;
+	}
+
+	return true;
+}
+
+/* @} END OF RTCAlarms */
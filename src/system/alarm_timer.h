@@ -0,0 +1,54 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************
+* @file alarm_timer.h
+*******************************************
+*/
+
+#ifndef _ALARM_TIMER_H_
+#define _ALARM_TIMER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+struct alarm_timer;
+struct dispatch_watch;
+
+typedef void (*AlarmTimerFunc)(struct alarm_timer *timer);
+
+struct alarm_timer
+{
+	int32_t fd;
+	struct dispatch_watch *watch;
+	AlarmTimerFunc func;
+	bool clock_watch;
+};
+
+#define ALARM_TIMER_INIT { .fd = -1 }
+
+bool alarm_timer_open(struct alarm_timer *timer, clockid_t clockid,
+                      AlarmTimerFunc func);
+void alarm_timer_close(struct alarm_timer *timer);
+bool alarm_timer_set(struct alarm_timer *timer, const struct timespec *expiry);
+bool alarm_timer_clear(struct alarm_timer *timer);
+bool alarm_timer_watch_clock_set(struct alarm_timer *timer, AlarmTimerFunc func);
+
+#endif
@@ -0,0 +1,298 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+****************************************************************
+* @file alarm_trace.c
+*
+* @brief Replays a recorded alarm trace on the simulated wakeup
+* backend and reports what it cost.
+*
+* A trace is a text file with one request per line:
+*
+*     <t> set <client> <delay>
+*     <t> range <client> <earliest delay> <latest delay>
+*     <t> elapsed <client> <delay>
+*     <t> nonwakeup <client> <delay>
+*     <t> periodic <client> <first delay> <interval>
+*     <t> cancel <client>
+*     <t> cancel_elapsed <client>
+*     <t> end
+*
+* <t> is the time of the request in seconds from the start of the
+* trace and must not decrease; delays are seconds from <t>. Each client
+* number stands for one callback/context pair, so a later request of the
+* same client moves its alarm. Empty lines and lines starting with '#'
+* are skipped. Without an "end" line the replay runs until no wakeup
+* alarm is left, so traces with periodic alarms need one. Non-wakeup
+* alarms are only delivered by the wakeups of other alarms.
+*
+* tools/sample.trace is an example, and tools/alarm_replay.c replays
+* traces from the command line.
+***************************************************************
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <stdbool.h>
+#include <glib.h>
+#include <nyx/nyx_module.h>
+#include "alarm_queue.h"
+#include "alarm_trace.h"
+#include "dispatch.h"
+#include "latency_stats.h"
+#include "wakeup.h"
+#include "timespec.h"
+
+#define TRACE_DRAIN_LIMIT 1000000
+
+/**
+ * @addtogroup RTCAlarms
+ * @{
+ */
+
+static uint64_t delivered = 0;
+
+static void
+trace_alarm_fired(nyx_device_handle_t handle, nyx_callback_status_t status,
+                  void *context)
+{
+	delivered++;
+}
+
+static inline struct timespec
+trace_expiry(AlarmClock clock, double delay)
+{
+	struct timespec now;
+
+	wakeup_clock_now(clock, &now);
+
+	return timespec_from_ns(timespec_to_ns(&now) + (int64_t)(delay * NSEC_PER_SEC));
+}
+
+/**
+* @brief Advance the virtual clocks to the next pending alarm.
+*
+* @retval false if nothing is pending
+*/
+
+static bool
+trace_advance_next(void)
+{
+	int64_t step = -1;
+	guint c;
+
+	for (c = 0; c < ALARM_CLOCK_COUNT; c++)
+	{
+		struct timespec next, now;
+		int64_t due;
+
+		if (!alarm_queue_next(c, &next))
+		{
+			continue;
+		}
+
+		wakeup_clock_now(c, &now);
+		due = MAX(timespec_to_ns(&next) - timespec_to_ns(&now), 0);
+
+		if (step < 0 || due < step)
+		{
+			step = due;
+		}
+	}
+
+	if (step < 0)
+	{
+		return false;
+	}
+
+	wakeup_sim_advance(step);
+
+	return true;
+}
+
+static bool
+trace_apply(const char *op, guint client, double a, double b, int fields,
+            guint line)
+{
+	void *context = GUINT_TO_POINTER(client);
+
+	if (!strcmp(op, "set") && fields >= 4)
+	{
+		struct timespec expiry = trace_expiry(ALARM_CLOCK_REALTIME, a);
+
+		return alarm_queue_set(ALARM_CLOCK_REALTIME, &expiry, trace_alarm_fired,
+		                       context) != 0;
+	}
+	else if (!strcmp(op, "range") && fields >= 5 && a <= b)
+	{
+		struct timespec earliest = trace_expiry(ALARM_CLOCK_REALTIME, a);
+		struct timespec latest = trace_expiry(ALARM_CLOCK_REALTIME, b);
+
+		return alarm_queue_set_range(ALARM_CLOCK_REALTIME, &earliest, &latest,
+		                             trace_alarm_fired, context) != 0;
+	}
+	else if (!strcmp(op, "elapsed") && fields >= 4)
+	{
+		struct timespec expiry = trace_expiry(ALARM_CLOCK_BOOTTIME, a);
+
+		return alarm_queue_set(ALARM_CLOCK_BOOTTIME, &expiry, trace_alarm_fired,
+		                       context) != 0;
+	}
+	else if (!strcmp(op, "nonwakeup") && fields >= 4)
+	{
+		struct timespec expiry = trace_expiry(ALARM_CLOCK_REALTIME, a);
+
+		return alarm_queue_set_nonwakeup(ALARM_CLOCK_REALTIME, &expiry, &expiry,
+		                                 trace_alarm_fired, context) != 0;
+	}
+	else if (!strcmp(op, "periodic") && fields >= 5 && b > 0)
+	{
+		struct timespec first = trace_expiry(ALARM_CLOCK_REALTIME, a);
+		struct timespec interval = timespec_from_ns((int64_t)(b * NSEC_PER_SEC));
+
+		return alarm_queue_set_periodic(ALARM_CLOCK_REALTIME, &first, &interval,
+		                                false, trace_alarm_fired, context) != 0;
+	}
+	else if (!strcmp(op, "cancel") && fields >= 3)
+	{
+		return alarm_queue_cancel(ALARM_CLOCK_REALTIME, trace_alarm_fired, context);
+	}
+	else if (!strcmp(op, "cancel_elapsed") && fields >= 3)
+	{
+		return alarm_queue_cancel(ALARM_CLOCK_BOOTTIME, trace_alarm_fired, context);
+	}
+
+	g_warning("%s: line %u: bad request '%s'", __FUNCTION__, line, op);
+
+	return false;
+}
+
+/**
+* @brief Replay the trace at path.
+*
+* The simulated backend must be in use. Alarms already pending are left
+* alone but show up in the wakeup and programming counts.
+*/
+
+bool
+alarm_trace_replay(const char *path, system_sim_report_t *report)
+{
+	system_latency_histogram_t before, after;
+	uint64_t wakeups, programs, wakeups_after, programs_after;
+	struct timespec start, end;
+	double elapsed = 0;
+	bool ended = false;
+	char buf[256];
+	guint line = 0;
+	FILE *f;
+
+	if (!wakeup_sim_active())
+	{
+		return false;
+	}
+
+	f = fopen(path, "r");
+
+	if (!f)
+	{
+		g_warning("%s: could not open %s", __FUNCTION__, path);
+		return false;
+	}
+
+	memset(report, 0, sizeof(*report));
+	memset(&before, 0, sizeof(before));
+	memset(&after, 0, sizeof(after));
+	dispatch_lock();
+	latency_stats_backend("sim", &before);
+	dispatch_unlock();
+	wakeup_sim_counts(&wakeups, &programs);
+	wakeup_clock_now(ALARM_CLOCK_BOOTTIME, &start);
+	delivered = 0;
+
+	while (!ended && fgets(buf, sizeof(buf), f))
+	{
+		char op[32];
+		guint client = 0;
+		double t, a = 0, b = 0;
+		int fields;
+
+		line++;
+
+		if (buf[0] == '#' || buf[0] == '\n')
+		{
+			continue;
+		}
+
+		fields = sscanf(buf, "%lf %31s %u %lf %lf", &t, op, &client, &a, &b);
+
+		if (fields < 2 || t < elapsed)
+		{
+			g_warning("%s: line %u: malformed or out of order", __FUNCTION__, line);
+			continue;
+		}
+
+		wakeup_sim_advance((int64_t)((t - elapsed) * NSEC_PER_SEC));
+		elapsed = t;
+
+		if (!strcmp(op, "end"))
+		{
+			ended = true;
+		}
+		else if (trace_apply(op, client, a, b, fields, line))
+		{
+			report->requests++;
+		}
+	}
+
+	fclose(f);
+
+	if (!ended)
+	{
+		guint i;
+
+		for (i = 0; i < TRACE_DRAIN_LIMIT && trace_advance_next(); i++);
+	}
+
+	wakeup_clock_now(ALARM_CLOCK_BOOTTIME, &end);
+	dispatch_lock();
+	latency_stats_backend("sim", &after);
+	dispatch_unlock();
+
+	wakeup_sim_counts(&wakeups_after, &programs_after);
+
+	report->delivered = delivered;
+	report->wakeups = wakeups_after - wakeups;
+	report->programs = programs_after - programs;
+	report->simulated_s = (timespec_to_ns(&end) - timespec_to_ns(&start)) / NSEC_PER_SEC;
+	report->total_late_us = after.total_us - before.total_us;
+	report->max_late_us = after.max_us;
+
+	g_message("trace %s: %" G_GUINT64_FORMAT " requests, %" G_GUINT64_FORMAT
+	          " delivered, %" G_GUINT64_FORMAT " wakeups, %" G_GUINT64_FORMAT
+	          " programming ops over %" G_GUINT64_FORMAT " s", path,
+	          (guint64)report->requests, (guint64)report->delivered,
+	          (guint64)report->wakeups, (guint64)report->programs,
+	          (guint64)report->simulated_s);
+
+	return true;
+}
+
+/* @} END OF RTCAlarms */
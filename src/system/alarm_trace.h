@@ -0,0 +1,33 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************
+* @file alarm_trace.h
+*******************************************
+*/
+
+#ifndef _ALARM_TRACE_H_
+#define _ALARM_TRACE_H_
+
+#include <stdbool.h>
+#include "system.h"
+
+bool alarm_trace_replay(const char *path, system_sim_report_t *report);
+
+#endif
@@ -0,0 +1,101 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************************************
+* @file config.c
+*******************************************************************
+*/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+#include "config.h"
+
+#define CONFIG_ENV_PREFIX "NYX_SYSTEM_"
+
+static const char *
+config_lookup(const char *key)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), CONFIG_ENV_PREFIX "%s", key);
+
+	return g_getenv(name);
+}
+
+const char *
+config_get_string(const char *key, const char *def)
+{
+	const char *value = config_lookup(key);
+
+	return (value && *value) ? value : def;
+}
+
+long
+config_get_int(const char *key, long def)
+{
+	const char *value = config_lookup(key);
+	char *end = NULL;
+	long ret;
+
+	if (!value || !*value)
+	{
+		return def;
+	}
+
+	errno = 0;
+	ret = strtol(value, &end, 0);
+
+	if (errno != 0 || *end != '\0')
+	{
+		g_warning("%s: ignoring invalid value '%s' for %s", __FUNCTION__, value, key);
+		return def;
+	}
+
+	return ret;
+}
+
+bool
+config_get_bool(const char *key, bool def)
+{
+	const char *value = config_lookup(key);
+
+	if (!value || !*value)
+	{
+		return def;
+	}
+
+	if (!strcmp(value, "1") || !g_ascii_strcasecmp(value, "true") ||
+	    !g_ascii_strcasecmp(value, "yes"))
+	{
+		return true;
+	}
+
+	if (!strcmp(value, "0") || !g_ascii_strcasecmp(value, "false") ||
+	    !g_ascii_strcasecmp(value, "no"))
+	{
+		return false;
+	}
+
+	g_warning("%s: ignoring invalid value '%s' for %s", __FUNCTION__, value, key);
+	return def;
+}
@@ -0,0 +1,37 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************
+* @file config.h
+*
+* @brief Tunables of the System module. Each key is read from the
+* environment of the hosting process as NYX_SYSTEM_<KEY>.
+*******************************************
+*/
+
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+
+#include <stdbool.h>
+
+long config_get_int(const char *key, long def);
+bool config_get_bool(const char *key, bool def);
+const char *config_get_string(const char *key, const char *def);
+
+#endif
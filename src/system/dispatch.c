@@ -0,0 +1,372 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+****************************************************************
+* @file dispatch.c
+*
+* @brief Runs the handlers of the fds the alarm path waits on.
+*
+* By default the fds are watched from the default GLib main context.
+* In threaded mode a dedicated thread waits on them with epoll
+* instead, so alarm delivery does not queue behind whatever else the
+* hosting daemon's main loop is busy with. All handlers run with the
+* dispatch lock held; it is recursive so callbacks may call back into
+* the module.
+***************************************************************
+*/
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <time.h>
+#include <glib.h>
+#include "dispatch.h"
+#include "syscall_stats.h"
+
+#define DISPATCH_MAX_EVENTS 16
+
+/**
+ * @addtogroup RTCAlarms
+ * @{
+ */
+
+struct dispatch_watch
+{
+	int fd;
+	DispatchFunc func;
+	void *data;
+	guint source;
+	bool removed;
+	struct dispatch_watch *next;
+};
+
+static GRecMutex dispatch_mutex;
+static GThread *dispatch_thread = NULL;
+static int epoll_fd = -1;
+static int control_fd = -1;
+static bool stopping = false;
+
+/* Watches removed while the thread may still hold an event for them.
+ * Pushed by any thread, freed by the dispatch thread once the batch of
+ * events it was working on is done. */
+static struct dispatch_watch *retired = NULL;
+
+/* when the fd event being handled was noticed, 0 outside of handlers,
+ * and the syscall count at that time */
+static int64_t event_start_ns = 0;
+static uint64_t event_syscalls = 0;
+
+static int64_t
+monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* with the lock held */
+static void
+run_watch(struct dispatch_watch *watch, int64_t noticed_ns)
+{
+	event_start_ns = noticed_ns;
+	event_syscalls = syscall_stats_total();
+	watch->func(watch->data);
+	event_start_ns = 0;
+}
+
+/**
+* @brief When the fd event whose handler is running was noticed, on
+* CLOCK_MONOTONIC, and the syscall count at that time. Needs the
+* dispatch lock.
+*
+* @retval false if not called from a handler
+*/
+
+bool
+dispatch_event_start(int64_t *start_ns, uint64_t *syscalls)
+{
+	if (!event_start_ns)
+	{
+		return false;
+	}
+
+	*start_ns = event_start_ns;
+	*syscalls = event_syscalls;
+
+	return true;
+}
+
+void
+dispatch_lock(void)
+{
+	g_rec_mutex_lock(&dispatch_mutex);
+}
+
+void
+dispatch_unlock(void)
+{
+	g_rec_mutex_unlock(&dispatch_mutex);
+}
+
+bool
+dispatch_threaded(void)
+{
+	return dispatch_thread != NULL;
+}
+
+static void
+control_kick(void)
+{
+	uint64_t one = 1;
+
+	if (write(control_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+	{
+		g_warning("%s: could not wake dispatch thread %d", __FUNCTION__, errno);
+	}
+}
+
+static void
+retire(struct dispatch_watch *watch)
+{
+	watch->next = __atomic_load_n(&retired, __ATOMIC_RELAXED);
+
+	while (!__atomic_compare_exchange_n(&retired, &watch->next, watch, true,
+	                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static void
+free_retired(void)
+{
+	struct dispatch_watch *watch = __atomic_exchange_n(&retired, NULL,
+	                                                   __ATOMIC_ACQUIRE);
+
+	while (watch)
+	{
+		struct dispatch_watch *next = watch->next;
+
+		free(watch);
+		watch = next;
+	}
+}
+
+static gpointer
+dispatch_run(gpointer data)
+{
+	struct epoll_event events[DISPATCH_MAX_EVENTS];
+
+	while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+	{
+		int n = epoll_wait(epoll_fd, events, DISPATCH_MAX_EVENTS, -1);
+		int64_t noticed = monotonic_ns();
+		int i;
+
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			g_critical("%s: epoll_wait failed %d", __FUNCTION__, errno);
+			break;
+		}
+
+		/* Everything that became ready is handled under a single lock
+		 * acquisition, so expiries arriving together fire together. */
+		dispatch_lock();
+
+		for (i = 0; i < n; i++)
+		{
+			struct dispatch_watch *watch = events[i].data.ptr;
+
+			if (!watch)
+			{
+				uint64_t count;
+
+				if (read(control_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+				{
+					g_warning("%s: control read failed %d", __FUNCTION__, errno);
+				}
+			}
+			else if (!watch->removed)
+			{
+				run_watch(watch, noticed);
+			}
+		}
+
+		dispatch_unlock();
+		free_retired();
+	}
+
+	return NULL;
+}
+
+/**
+* @brief Select how fds are watched. Must be called before any watch is
+* added.
+*
+* @param threaded watch from a dedicated epoll thread instead of the
+* GLib main loop
+*/
+
+bool
+dispatch_init(bool threaded)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+
+	if (!threaded || dispatch_thread)
+	{
+		return true;
+	}
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	control_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (epoll_fd < 0 || control_fd < 0 ||
+	    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, control_fd, &ev) < 0)
+	{
+		g_warning("%s: falling back to the main loop, setup failed %d",
+		          __FUNCTION__, errno);
+		dispatch_shutdown();
+		return false;
+	}
+
+	stopping = false;
+	dispatch_thread = g_thread_new("nyx-system-alarm", dispatch_run, NULL);
+
+	return true;
+}
+
+void
+dispatch_shutdown(void)
+{
+	if (dispatch_thread)
+	{
+		__atomic_store_n(&stopping, true, __ATOMIC_RELEASE);
+		control_kick();
+		g_thread_join(dispatch_thread);
+		dispatch_thread = NULL;
+		free_retired();
+	}
+
+	if (control_fd >= 0)
+	{
+		close(control_fd);
+		control_fd = -1;
+	}
+
+	if (epoll_fd >= 0)
+	{
+		close(epoll_fd);
+		epoll_fd = -1;
+	}
+}
+
+static gboolean
+dispatch_glib_event(GIOChannel *source, GIOCondition condition, gpointer ctx)
+{
+	struct dispatch_watch *watch = (struct dispatch_watch *)ctx;
+	int64_t noticed = monotonic_ns();
+
+	dispatch_lock();
+	run_watch(watch, noticed);
+	dispatch_unlock();
+
+	return TRUE;
+}
+
+/**
+* @brief Call func whenever fd becomes readable.
+*
+* The handler must consume whatever made the fd readable.
+*
+* @retval the watch, NULL on failure
+*/
+
+struct dispatch_watch *
+dispatch_add_watch(int fd, DispatchFunc func, void *data)
+{
+	struct dispatch_watch *watch = calloc(1, sizeof(struct dispatch_watch));
+
+	if (!watch)
+	{
+		return NULL;
+	}
+
+	watch->fd = fd;
+	watch->func = func;
+	watch->data = data;
+
+	if (dispatch_thread)
+	{
+		struct epoll_event ev = { .events = EPOLLIN, .data.ptr = watch };
+
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		{
+			g_warning("%s: could not watch fd %d: %d", __FUNCTION__, fd, errno);
+			free(watch);
+			return NULL;
+		}
+	}
+	else
+	{
+		GIOChannel *channel = g_io_channel_unix_new(fd);
+
+		watch->source = g_io_add_watch(channel, G_IO_IN, dispatch_glib_event, watch);
+		g_io_channel_unref(channel);
+	}
+
+	return watch;
+}
+
+/**
+* @brief Stop watching. Must be called before the fd is closed.
+*/
+
+void
+dispatch_remove_watch(struct dispatch_watch *watch)
+{
+	if (!watch)
+	{
+		return;
+	}
+
+	if (watch->source)
+	{
+		g_source_remove(watch->source);
+		free(watch);
+		return;
+	}
+
+	dispatch_lock();
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, watch->fd, NULL);
+	watch->removed = true;
+	dispatch_unlock();
+
+	retire(watch);
+	control_kick();
+}
+
+/* @} END OF RTCAlarms */
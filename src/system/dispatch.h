@@ -0,0 +1,44 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************
+* @file dispatch.h
+*******************************************
+*/
+
+#ifndef _DISPATCH_H_
+#define _DISPATCH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct dispatch_watch;
+
+typedef void (*DispatchFunc)(void *data);
+
+bool dispatch_init(bool threaded);
+void dispatch_shutdown(void);
+bool dispatch_threaded(void);
+struct dispatch_watch *dispatch_add_watch(int fd, DispatchFunc func, void *data);
+void dispatch_remove_watch(struct dispatch_watch *watch);
+void dispatch_lock(void);
+void dispatch_unlock(void);
+bool dispatch_event_start(int64_t *start_ns, uint64_t *syscalls);
+
+#endif
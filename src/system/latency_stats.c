@@ -0,0 +1,350 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************************************
+* @file latency_stats.c
+*
+* @brief Histograms of how late alarms are delivered, i.e. the time
+* between an alarm's scheduled expiry and the moment its callback is
+* run. One histogram is kept per wakeup backend and one per client.
+*
+* Separately the time the module itself takes, from noticing a wakeup
+* fd event to running each callback, is sampled to tell regressions in
+* the fire path apart from hardware latency.
+*******************************************************************
+*/
+
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <glib.h>
+#include <nyx/nyx_module.h>
+#include "latency_stats.h"
+#include "wakeup.h"
+
+#define LATENCY_BACKENDS WAKEUP_BACKEND_COUNT
+#define LATENCY_CLIENTS  32
+#define FIRE_PATH_SAMPLES 1024
+
+/* upper bound of each bucket in microseconds, the last one is open */
+static const uint64_t bucket_limits[SYSTEM_LATENCY_BUCKETS] =
+{
+	1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000,
+	1000000, 5000000, UINT64_MAX
+};
+
+struct backend_latency
+{
+	const char *name;
+	system_latency_histogram_t hist;
+};
+
+struct client_latency
+{
+	nyx_device_callback_function_t func;
+	void *context;
+	system_latency_histogram_t hist;
+};
+
+static struct backend_latency backends[LATENCY_BACKENDS];
+static struct client_latency clients[LATENCY_CLIENTS];
+static guint nclients = 0;
+static bool clients_full_logged = false;
+
+/* the most recent fire path samples, oldest overwritten first */
+static struct
+{
+	int64_t samples[FIRE_PATH_SAMPLES];
+	guint next;
+	uint64_t count;
+	uint64_t passes;
+	uint64_t syscalls;
+	int64_t max_ns;
+} fire_path;
+
+static void
+histogram_add(system_latency_histogram_t *hist, uint64_t late_us)
+{
+	unsigned int bucket = 0;
+
+	while (late_us > bucket_limits[bucket])
+	{
+		bucket++;
+	}
+
+	hist->buckets[bucket]++;
+	hist->count++;
+	hist->total_us += late_us;
+
+	if (late_us > hist->max_us)
+	{
+		hist->max_us = late_us;
+	}
+}
+
+static struct backend_latency *
+find_backend(const char *name, bool create)
+{
+	guint i;
+
+	for (i = 0; i < LATENCY_BACKENDS && backends[i].name; i++)
+	{
+		if (!strcmp(backends[i].name, name))
+		{
+			return &backends[i];
+		}
+	}
+
+	if (!create || i == LATENCY_BACKENDS)
+	{
+		return NULL;
+	}
+
+	backends[i].name = name;
+
+	return &backends[i];
+}
+
+static struct client_latency *
+find_client(nyx_device_callback_function_t func, void *context, bool create)
+{
+	guint i;
+
+	for (i = 0; i < nclients; i++)
+	{
+		if (clients[i].func == func && clients[i].context == context)
+		{
+			return &clients[i];
+		}
+	}
+
+	if (!create)
+	{
+		return NULL;
+	}
+
+	if (nclients == LATENCY_CLIENTS)
+	{
+		if (!clients_full_logged)
+		{
+			g_debug("%s: client table full, not tracking further clients",
+			        __FUNCTION__);
+			clients_full_logged = true;
+		}
+
+		return NULL;
+	}
+
+	clients[nclients].func = func;
+	clients[nclients].context = context;
+
+	return &clients[nclients++];
+}
+
+/**
+* @brief Record the delivery of one alarm.
+*
+* @param backend name of the wakeup backend the alarm was armed on, or NULL
+* to record for the client only
+* @param func callback of the client, NULL for alarms that are only
+* reported in batches
+* @param late_ns time from the scheduled expiry to the callback; alarms
+* delivered early because their window was coalesced count as on time
+*/
+
+void
+latency_stats_record(const char *backend, nyx_device_callback_function_t func,
+                     void *context, int64_t late_ns)
+{
+	uint64_t late_us = late_ns > 0 ? late_ns / 1000 : 0;
+	struct backend_latency *b;
+	struct client_latency *c;
+
+	if (backend && (b = find_backend(backend, true)))
+	{
+		histogram_add(&b->hist, late_us);
+	}
+
+	if (func && (c = find_client(func, context, true)))
+	{
+		histogram_add(&c->hist, late_us);
+	}
+}
+
+bool
+latency_stats_backend(const char *backend, system_latency_histogram_t *hist)
+{
+	struct backend_latency *b = find_backend(backend, false);
+
+	if (!b)
+	{
+		return false;
+	}
+
+	*hist = b->hist;
+
+	return true;
+}
+
+bool
+latency_stats_client(nyx_device_callback_function_t func, void *context,
+                     system_latency_histogram_t *hist)
+{
+	struct client_latency *c = find_client(func, context, false);
+
+	if (!c)
+	{
+		return false;
+	}
+
+	*hist = c->hist;
+
+	return true;
+}
+
+/**
+* @brief Record the time from the wakeup event to one callback.
+*/
+
+void
+latency_stats_fire_path(int64_t ns)
+{
+	fire_path.samples[fire_path.next] = ns;
+	fire_path.next = (fire_path.next + 1) % FIRE_PATH_SAMPLES;
+	fire_path.count++;
+
+	if (ns > fire_path.max_ns)
+	{
+		fire_path.max_ns = ns;
+	}
+}
+
+/**
+* @brief Record one wakeup event handled, with the syscalls it took from
+* the event to re-arming.
+*/
+
+void
+latency_stats_fire_pass(uint64_t syscalls)
+{
+	fire_path.passes++;
+	fire_path.syscalls += syscalls;
+}
+
+static int
+compare_ns(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/**
+* @brief Percentiles over the most recent fire path samples.
+*/
+
+void
+latency_stats_fire(system_fire_path_stats_t *stats)
+{
+	guint n = MIN(fire_path.count, FIRE_PATH_SAMPLES);
+	int64_t *sorted;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->samples = fire_path.count;
+	stats->passes = fire_path.passes;
+	stats->syscalls = fire_path.syscalls;
+	stats->max_ns = fire_path.max_ns;
+
+	if (n == 0 || !(sorted = malloc(n * sizeof(*sorted))))
+	{
+		return;
+	}
+
+	memcpy(sorted, fire_path.samples, n * sizeof(*sorted));
+	qsort(sorted, n, sizeof(*sorted), compare_ns);
+	stats->p50_ns = sorted[(n - 1) / 2];
+	stats->p99_ns = sorted[(n - 1) * 99 / 100];
+	free(sorted);
+}
+
+static void
+histogram_dump(const char *label, const system_latency_histogram_t *hist)
+{
+	GString *line = g_string_new(NULL);
+	unsigned int i;
+
+	for (i = 0; i < SYSTEM_LATENCY_BUCKETS; i++)
+	{
+		if (bucket_limits[i] == UINT64_MAX)
+		{
+			g_string_append_printf(line, " >%" G_GUINT64_FORMAT "ms:%" G_GUINT64_FORMAT,
+			                       bucket_limits[i - 1] / 1000, (guint64)hist->buckets[i]);
+		}
+		else
+		{
+			g_string_append_printf(line, " <=%" G_GUINT64_FORMAT "ms:%" G_GUINT64_FORMAT,
+			                       bucket_limits[i] / 1000, (guint64)hist->buckets[i]);
+		}
+	}
+
+	g_message("latency: %s count %" G_GUINT64_FORMAT " avg %" G_GUINT64_FORMAT
+	          "us max %" G_GUINT64_FORMAT "us%s", label, (guint64)hist->count,
+	          hist->count ? (guint64)(hist->total_us / hist->count) : 0,
+	          (guint64)hist->max_us, line->str);
+
+	g_string_free(line, TRUE);
+}
+
+void
+latency_stats_dump(void)
+{
+	system_fire_path_stats_t fire;
+	guint i;
+
+	for (i = 0; i < LATENCY_BACKENDS && backends[i].name; i++)
+	{
+		gchar *label = g_strdup_printf("backend %s", backends[i].name);
+
+		histogram_dump(label, &backends[i].hist);
+		g_free(label);
+	}
+
+	for (i = 0; i < nclients; i++)
+	{
+		gchar *label = g_strdup_printf("client %p/%p", (void *)clients[i].func,
+		                               clients[i].context);
+
+		histogram_dump(label, &clients[i].hist);
+		g_free(label);
+	}
+
+	latency_stats_fire(&fire);
+
+	if (fire.samples)
+	{
+		g_message("latency: fire path p50 %" G_GUINT64_FORMAT "us p99 %"
+		          G_GUINT64_FORMAT "us max %" G_GUINT64_FORMAT "us, %"
+		          G_GUINT64_FORMAT " syscalls in %" G_GUINT64_FORMAT " wakeups",
+		          (guint64)fire.p50_ns / 1000, (guint64)fire.p99_ns / 1000,
+		          (guint64)fire.max_ns / 1000, (guint64)fire.syscalls,
+		          (guint64)fire.passes);
+	}
+}
@@ -0,0 +1,45 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************
+* @file latency_stats.h
+*******************************************
+*/
+
+#ifndef _LATENCY_STATS_H_
+#define _LATENCY_STATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <nyx/nyx_module.h>
+#include "system.h"
+
+void latency_stats_record(const char *backend,
+                          nyx_device_callback_function_t func, void *context,
+                          int64_t late_ns);
+bool latency_stats_backend(const char *backend,
+                           system_latency_histogram_t *hist);
+bool latency_stats_client(nyx_device_callback_function_t func, void *context,
+                          system_latency_histogram_t *hist);
+void latency_stats_fire_path(int64_t ns);
+void latency_stats_fire_pass(uint64_t syscalls);
+void latency_stats_fire(system_fire_path_stats_t *stats);
+void latency_stats_dump(void);
+
+#endif
@@ -0,0 +1,289 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************************************
+* @file power_stats.c
+*
+* @brief What keeps the device awake: how often and how long each wake
+* lock taken through this module was held, and how suspend cycles went.
+* Everything lives in fixed-size tables; wake locks beyond the table
+* are still taken, just not accounted for, and only the most recent
+* cycles are kept.
+*******************************************************************
+*/
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <glib.h>
+#include <libsuspend.h>
+#include "power_stats.h"
+#include "timespec.h"
+
+#define WAKELOCK_STATS 16
+#define CYCLE_RECORDS  32
+
+struct wakelock_stats
+{
+	system_wakelock_stats_t stats;
+	int64_t acquired_ns;
+};
+
+static GMutex stats_mutex;
+
+static struct wakelock_stats wakelocks[WAKELOCK_STATS];
+static guint nwakelocks = 0;
+
+static system_suspend_stats_t totals;
+static system_suspend_cycle_t cycles[CYCLE_RECORDS];
+static guint next_cycle = 0;
+
+static int64_t
+boottime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+
+	return timespec_to_ns(&ts);
+}
+
+/**
+* @brief The lock's entry, or with create a new one if there is room.
+*/
+
+static struct wakelock_stats *
+find_wakelock(const char *name, bool create)
+{
+	guint i;
+
+	for (i = 0; i < nwakelocks; i++)
+	{
+		if (!strncmp(wakelocks[i].stats.name, name, SYSTEM_WAKELOCK_NAME_MAX - 1))
+		{
+			return &wakelocks[i];
+		}
+	}
+
+	if (!create || nwakelocks == WAKELOCK_STATS)
+	{
+		return NULL;
+	}
+
+	g_strlcpy(wakelocks[nwakelocks].stats.name, name, SYSTEM_WAKELOCK_NAME_MAX);
+
+	return &wakelocks[nwakelocks++];
+}
+
+/**
+* @brief Take a wake lock through libsuspend and account for it. Taking
+* a lock that is held already does not start another hold.
+*/
+
+int
+power_stats_acquire_wake_lock(const char *name)
+{
+	struct wakelock_stats *w;
+	int ret = libsuspend_acquire_wake_lock(name);
+
+	if (ret != 0)
+	{
+		return ret;
+	}
+
+	g_mutex_lock(&stats_mutex);
+
+	if ((w = find_wakelock(name, true)) && !w->stats.held)
+	{
+		w->stats.held = true;
+		w->stats.count++;
+		w->acquired_ns = boottime_ns();
+	}
+
+	g_mutex_unlock(&stats_mutex);
+
+	return ret;
+}
+
+int
+power_stats_release_wake_lock(const char *name)
+{
+	struct wakelock_stats *w;
+	int ret = libsuspend_release_wake_lock(name);
+
+	g_mutex_lock(&stats_mutex);
+
+	/* a lock never taken through here has nothing to account for */
+	if ((w = find_wakelock(name, false)) && w->stats.held)
+	{
+		int64_t held = boottime_ns() - w->acquired_ns;
+
+		w->stats.held = false;
+		w->stats.total_ns += held;
+		w->stats.max_ns = MAX(w->stats.max_ns, (uint64_t)held);
+	}
+
+	g_mutex_unlock(&stats_mutex);
+
+	return ret;
+}
+
+/**
+* @brief Account for a suspend cycle that has ended.
+*/
+
+void
+power_stats_cycle(const system_suspend_cycle_t *cycle)
+{
+	g_mutex_lock(&stats_mutex);
+
+	totals.attempts++;
+
+	if (cycle->state == SYSTEM_SUSPEND_ABORTED)
+	{
+		totals.aborts++;
+	}
+
+	totals.suspended_ns += cycle->suspended_ns;
+	totals.max_resume_ns = MAX(totals.max_resume_ns, cycle->resume_ns);
+
+	cycles[next_cycle] = *cycle;
+	next_cycle = (next_cycle + 1) % CYCLE_RECORDS;
+
+	g_mutex_unlock(&stats_mutex);
+}
+
+/**
+* @brief Account for a suspend avoided because the next alarm was due too
+* soon.
+*/
+
+void
+power_stats_avoided(void)
+{
+	g_mutex_lock(&stats_mutex);
+	totals.avoided++;
+	g_mutex_unlock(&stats_mutex);
+}
+
+/**
+* @brief Fill out with up to max wake locks, the ones held longest in
+* total first. Locks held right now count up to now.
+*
+* @retval number of entries filled in
+*/
+
+guint
+power_stats_wakelocks(system_wakelock_stats_t *out, guint max)
+{
+	int64_t now = boottime_ns();
+	guint i, j, n = 0;
+
+	g_mutex_lock(&stats_mutex);
+
+	for (i = 0; i < nwakelocks; i++)
+	{
+		system_wakelock_stats_t w = wakelocks[i].stats;
+
+		if (w.held)
+		{
+			uint64_t held = now - wakelocks[i].acquired_ns;
+
+			w.total_ns += held;
+			w.max_ns = MAX(w.max_ns, held);
+		}
+
+		/* insertion into the sorted output, the table is small */
+		for (j = n; j > 0 && out[j - 1].total_ns < w.total_ns; j--)
+		{
+			if (j < max)
+			{
+				out[j] = out[j - 1];
+			}
+		}
+
+		if (j < max)
+		{
+			out[j] = w;
+			n = MIN(n + 1, max);
+		}
+	}
+
+	g_mutex_unlock(&stats_mutex);
+
+	return n;
+}
+
+/**
+* @brief Totals over all suspend cycles and up to max of the most
+* recent cycles, newest first.
+*
+* @retval number of cycles filled in
+*/
+
+guint
+power_stats_cycles(system_suspend_stats_t *stats, system_suspend_cycle_t *out,
+                   guint max)
+{
+	guint i, n;
+
+	g_mutex_lock(&stats_mutex);
+
+	if (stats)
+	{
+		*stats = totals;
+	}
+
+	n = out ? MIN(max, MIN(totals.attempts, CYCLE_RECORDS)) : 0;
+
+	for (i = 0; i < n; i++)
+	{
+		out[i] = cycles[(next_cycle + CYCLE_RECORDS - 1 - i) % CYCLE_RECORDS];
+	}
+
+	g_mutex_unlock(&stats_mutex);
+
+	return n;
+}
+
+void
+power_stats_dump(void)
+{
+	system_wakelock_stats_t locks[WAKELOCK_STATS];
+	system_suspend_stats_t stats;
+	guint i, n;
+
+	n = power_stats_wakelocks(locks, WAKELOCK_STATS);
+
+	for (i = 0; i < n; i++)
+	{
+		g_message("wakelock: %s%s held %" G_GUINT64_FORMAT " times, total %"
+		          G_GUINT64_FORMAT "ms max %" G_GUINT64_FORMAT "ms", locks[i].name,
+		          locks[i].held ? " (held)" : "", (guint64)locks[i].count,
+		          (guint64)locks[i].total_ns / 1000000, (guint64)locks[i].max_ns / 1000000);
+	}
+
+	power_stats_cycles(&stats, NULL, 0);
+	g_message("suspend: %" G_GUINT64_FORMAT " attempts, %" G_GUINT64_FORMAT
+	          " aborted, %" G_GUINT64_FORMAT " avoided, %" G_GUINT64_FORMAT
+	          "s suspended, resume max %" G_GUINT64_FORMAT "us",
+	          (guint64)stats.attempts, (guint64)stats.aborts, (guint64)stats.avoided,
+	          (guint64)stats.suspended_ns / 1000000000, (guint64)stats.max_resume_ns / 1000);
+}
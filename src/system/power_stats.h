@@ -0,0 +1,40 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************
+* @file power_stats.h
+*******************************************
+*/
+
+#ifndef _POWER_STATS_H_
+#define _POWER_STATS_H_
+
+#include <glib.h>
+#include "system.h"
+
+int power_stats_acquire_wake_lock(const char *name);
+int power_stats_release_wake_lock(const char *name);
+void power_stats_cycle(const system_suspend_cycle_t *cycle);
+void power_stats_avoided(void);
+guint power_stats_wakelocks(system_wakelock_stats_t *out, guint max);
+guint power_stats_cycles(system_suspend_stats_t *stats,
+                         system_suspend_cycle_t *out, guint max);
+void power_stats_dump(void);
+
+#endif
@@ -39,7 +39,9 @@
 #include "wait.h"
 //#include "debug.h"
 #include "rtc.h"
-#include "alarm.h"
+#include "timespec.h"
+#include "syscall_stats.h"
+#include "dispatch.h"
 
 #ifdef BUILD_FOR_DESKTOP
 #define DEV_RTC_IMPLEMENTED 0
@@ -53,6 +55,45 @@
  */
 
 int32_t rtc_fd = -1;
+/* set to use another device than the usual ones, e.g. a stand-in */
+static const char *rtc_device = NULL;
+
+/* last alarm written with RTC_WKALM_SET, enabled = 0 if none */
+static struct rtc_wkalrm rtc_programmed;
+
+static struct
+{
+	bool valid;
+	bool audit;
+	gint64 interval_ns;
+	gint64 offset_ns;
+	gint64 validated_ns;
+	time_t last_drift;
+	time_t max_drift;
+} rtc_cache = {
+	.interval_ns = 600 * NSEC_PER_SEC,
+};
+
+/* RTC against the wall clock, sampled on every resume */
+static struct
+{
+	bool anchored;
+	bool measured;
+	gint64 anchor_wall_ns;
+	gint64 anchor_diff_ns;
+	gint64 diff_ns;
+	gint64 rate_ppb;
+	guint estimates;
+} rtc_drift;
+
+/* rtc_cache and rtc_drift are used from the dispatcher, the suspend
+ * worker and any thread querying the RTC time; taken after, never
+ * around, the dispatch lock */
+static GRecMutex state_lock;
+
+/* samples closer than this say more about the 1 s RTC resolution than
+ * about drift */
+#define RTC_DRIFT_MIN_SPAN_NS (3600 * NSEC_PER_SEC)
 
 #define STD_ASCTIME_BUF_SIZE    26
 
@@ -110,6 +151,16 @@ tm_to_rtc_wkalrm(struct tm *tm_time, struct rtc_wkalrm *alarm)
 	alarm->pending = 0;
 }
 
+/**
+ * @brief Open path instead of /dev/rtc or /dev/rtc0, NULL to go back to
+ * those. Takes effect on the next rtc_open().
+ */
+void
+rtc_set_device(const char *path)
+{
+	rtc_device = path;
+}
+
 /**
  * @brief Open rtc device.
  *
@@ -122,12 +173,28 @@ rtc_open()
 	if (rtc_fd >= 0)
 		return true;
 
-	rtc_fd = open("/dev/rtc", O_RDONLY);
+	if (rtc_device)
+	{
+		syscall_stats_inc(SYSCALL_DEV_OPEN);
+		rtc_fd = open(rtc_device, O_RDONLY | O_CLOEXEC);
+
+		if (rtc_fd < 0)
+		{
+			g_critical("Could not open rtc device %s. %d", rtc_device, errno);
+			return false;
+		}
+
+		return true;
+	}
+
+	syscall_stats_inc(SYSCALL_DEV_OPEN);
+	rtc_fd = open("/dev/rtc", O_RDONLY | O_CLOEXEC);
 
 	if (rtc_fd < 0)
 	{
 		int32_t err1 = errno;
-		rtc_fd = open("/dev/rtc0", O_RDONLY);
+		syscall_stats_inc(SYSCALL_DEV_OPEN);
+		rtc_fd = open("/dev/rtc0", O_RDONLY | O_CLOEXEC);
 
 		if (rtc_fd < 0)
 		{
@@ -137,8 +204,6 @@ rtc_open()
 		}
 	}
 
-	android_alarm_open();
-
 	return true;
 #else
 	g_debug("Powerd RTC code disabled");
@@ -152,8 +217,8 @@ rtc_open()
 * @brief The callback function called when the rtc driver notifies an alarm expiry.
 */
 
-static gboolean
-rtc_event(GIOChannel *source, GIOCondition condition, gpointer ctx)
+static void
+rtc_event(void *ctx)
 {
 	RtcAlarmFunc func = (RtcAlarmFunc)ctx;
 
@@ -161,32 +226,28 @@ rtc_event(GIOChannel *source, GIOCondition condition, gpointer ctx)
 	{
 		func();
 	}
-
-	return TRUE;
 }
 #endif
 
 /**
 * @brief Attach a watching.
 *
+* The fd stays open until rtc_close(), whether or not it is watched.
 */
 
-static GIOChannel *rtc_channel = NULL;
-static guint rtc_watch;
+static struct dispatch_watch *rtc_watch = NULL;
 
 bool
 rtc_add_watch(RtcAlarmFunc func)
 {
 #if DEV_RTC_IMPLEMENTED
 
-	if (rtc_channel == NULL)
+	if (rtc_watch == NULL)
 	{
-		rtc_channel = g_io_channel_unix_new(rtc_fd);
-		rtc_watch = g_io_add_watch(rtc_channel, G_IO_IN, rtc_event, func);
-		g_io_channel_unref(rtc_channel);
+		rtc_watch = dispatch_add_watch(rtc_fd, rtc_event, func);
 	}
 
-	return true;
+	return rtc_watch != NULL;
 #else
 	return false;
 #endif
@@ -197,14 +258,10 @@ rtc_clear_watch(void)
 {
 #if DEV_RTC_IMPLEMENTED
 
-	if (rtc_channel)
+	if (rtc_watch)
 	{
-		g_io_channel_shutdown(rtc_channel, true, NULL);
-		rtc_channel = NULL;
-
-		g_source_remove(rtc_watch);
-
-		rtc_close();
+		dispatch_remove_watch(rtc_watch);
+		rtc_watch = NULL;
 	}
 
 	return true;
@@ -219,13 +276,16 @@ rtc_clear_watch(void)
 void
 rtc_close()
 {
+	rtc_clear_watch();
+
 	if (rtc_fd >= 0)
 	{
+		syscall_stats_inc(SYSCALL_DEV_CLOSE);
 		close(rtc_fd);
 		rtc_fd = -1;
 	}
 
-	android_alarm_close();
+	rtc_programmed.enabled = 0;
 }
 
 /**
@@ -253,6 +313,7 @@ rtc_read(struct tm *tm_time)
 
 	struct rtc_time rtc_time;
 
+	syscall_stats_inc(SYSCALL_RTC_RD_TIME);
 	int32_t ret = ioctl(rtc_fd, RTC_RD_TIME, &rtc_time);
 
 	if (ret < 0)
@@ -271,10 +332,52 @@ rtc_read(struct tm *tm_time)
 }
 
 /**
-* @brief Read the RTC time and convert it in time_t.
+* @brief Set the RTC time, given in UTC.
+*
+* Everything derived from the previous RTC time is dropped: the cache
+* and the drift model are measured again right away.
 */
 
-time_t rtc_time(time_t *time)
+bool
+rtc_write(struct tm *tm_time)
+{
+#if DEV_RTC_IMPLEMENTED
+
+	struct rtc_time rtc_time;
+
+	if (!tm_time)
+	{
+		return false;
+	}
+
+	tm_to_rtc_time(tm_time, &rtc_time);
+
+	syscall_stats_inc(SYSCALL_RTC_SET_TIME);
+
+	if (ioctl(rtc_fd, RTC_SET_TIME, &rtc_time) < 0)
+	{
+		g_critical("RTC_SET_TIME ioctl %d", errno);
+		return false;
+	}
+
+	g_rec_mutex_lock(&state_lock);
+	rtc_cache_invalidate();
+	rtc_drift_reanchor();
+	rtc_drift_sample();
+	g_rec_mutex_unlock(&state_lock);
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+* @brief Read the RTC time from the hardware and convert it in time_t.
+*/
+
+static time_t
+rtc_time_hw(time_t *time)
 {
 	struct tm tm;
 	time_t t;
@@ -298,16 +401,346 @@ time_t rtc_time(time_t *time)
 	return t;
 }
 
+static gint64
+boottime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+
+	return (gint64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+* @brief Remember the offset between the RTC and CLOCK_BOOTTIME.
+*
+* A single RTC read only tells us the RTC was somewhere in
+* [rtc, rtc + 1) when it was taken, so the offset we keep is the
+* largest lower bound seen since the last reset. Both clocks keep
+* running through suspend, so the offset only moves with drift.
+*/
+
+static void
+rtc_cache_update(time_t rtc, gint64 boot)
+{
+	gint64 offset = (gint64)rtc * NSEC_PER_SEC - boot;
+
+	if (!rtc_cache.valid || offset > rtc_cache.offset_ns ||
+	    offset + NSEC_PER_SEC <= rtc_cache.offset_ns)
+	{
+		rtc_cache.offset_ns = offset;
+	}
+
+	rtc_cache.valid = true;
+	rtc_cache.validated_ns = boot;
+}
+
+static time_t
+rtc_cache_predict(gint64 boot)
+{
+	gint64 ns = boot + rtc_cache.offset_ns;
+
+	/* floor division, the offset may be negative */
+	return (time_t)((ns - (ns < 0 ? NSEC_PER_SEC - 1 : 0)) / NSEC_PER_SEC);
+}
+
+void
+rtc_cache_configure(long interval, bool audit)
+{
+	g_rec_mutex_lock(&state_lock);
+	rtc_cache.interval_ns = interval > 0 ? (gint64)interval * NSEC_PER_SEC : 0;
+	rtc_cache.audit = audit;
+	rtc_cache.valid = false;
+	g_rec_mutex_unlock(&state_lock);
+}
+
+/**
+* @brief Force the next rtc_time() to read the hardware.
+*
+* Called on resume and whenever the wall clock was changed.
+*/
+
+void
+rtc_cache_invalidate(void)
+{
+	g_rec_mutex_lock(&state_lock);
+	rtc_cache.valid = false;
+	g_rec_mutex_unlock(&state_lock);
+}
+
+/**
+* @brief Difference between the real RTC and the cached value, in seconds,
+* at the last validation and the largest seen so far.
+*/
+
+void
+rtc_cache_drift(time_t *last, time_t *max)
+{
+	g_rec_mutex_lock(&state_lock);
+
+	if (last)
+	{
+		*last = rtc_cache.last_drift;
+	}
+
+	if (max)
+	{
+		*max = rtc_cache.max_drift;
+	}
+
+	g_rec_mutex_unlock(&state_lock);
+}
+
+static time_t
+rtc_time_cached(time_t *time)
+{
+	gint64 boot = boottime_ns();
+	bool fresh = rtc_cache.valid &&
+	             boot - rtc_cache.validated_ns < rtc_cache.interval_ns;
+	time_t t;
+
+	if (fresh && !rtc_cache.audit)
+	{
+		t = rtc_cache_predict(boot);
+
+		if (time)
+		{
+			*time = t;
+		}
+
+		return t;
+	}
+
+	if (rtc_time_hw(&t) < 0)
+	{
+		return -1;
+	}
+
+	if (rtc_cache.valid)
+	{
+		time_t drift = t - rtc_cache_predict(boot);
+
+		rtc_cache.last_drift = drift;
+
+		if (ABS(drift) > ABS(rtc_cache.max_drift))
+		{
+			rtc_cache.max_drift = drift;
+		}
+
+		if (drift != 0 && rtc_cache.audit)
+		{
+			g_debug("%s: cached rtc time off by %ld s", __FUNCTION__, (long)drift);
+		}
+	}
+
+	if (rtc_cache.interval_ns > 0)
+	{
+		rtc_cache_update(t, boot);
+	}
+
+	if (time)
+	{
+		*time = t;
+	}
+
+	return t;
+}
+
+/**
+* @brief Read the RTC time and convert it in time_t.
+*
+* Served from CLOCK_BOOTTIME plus the cached RTC offset while the cache
+* is valid; the RTC itself is only read once per validation interval.
+* In audit mode the RTC is read on every call and the difference to the
+* cached value is recorded instead.
+*/
+
+time_t rtc_time(time_t *time)
+{
+	time_t t;
+
+	g_rec_mutex_lock(&state_lock);
+	t = rtc_time_cached(time);
+	g_rec_mutex_unlock(&state_lock);
+
+	return t;
+}
+
+/**
+* @brief Difference between the RTC and the wall clock, RTC minus wall,
+* in seconds.
+*/
+
+bool
+wall_rtc_diff(time_t *ret_delta)
+{
+	time_t rtc;
+
+	if (!ret_delta || rtc_time_hw(&rtc) < 0)
+	{
+		return false;
+	}
+
+	*ret_delta = rtc - time(NULL);
+
+	return true;
+}
+
+/**
+* @brief Compare the RTC with the wall clock and update the drift model.
+*
+* The drift rate is measured against the first sample taken since the
+* wall clock was last set, so its error from the 1 s RTC resolution
+* shrinks as the span grows; successive estimates are smoothed.
+*/
+
+bool
+rtc_drift_sample(void)
+{
+	struct timespec wall;
+	gint64 wall_ns, diff;
+	time_t rtc;
+
+	g_rec_mutex_lock(&state_lock);
+
+	if (rtc_time_hw(&rtc) < 0)
+	{
+		g_rec_mutex_unlock(&state_lock);
+		return false;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &wall);
+	wall_ns = timespec_to_ns(&wall);
+	diff = (gint64)rtc * NSEC_PER_SEC - wall_ns;
+
+	rtc_drift.diff_ns = diff;
+	rtc_drift.measured = true;
+
+	if (!rtc_drift.anchored)
+	{
+		rtc_drift.anchor_wall_ns = wall_ns;
+		rtc_drift.anchor_diff_ns = diff;
+		rtc_drift.anchored = true;
+	}
+	else if (wall_ns - rtc_drift.anchor_wall_ns >= RTC_DRIFT_MIN_SPAN_NS)
+	{
+		gint64 rate = (gint64)((double)(diff - rtc_drift.anchor_diff_ns) * 1e9 /
+		                       (double)(wall_ns - rtc_drift.anchor_wall_ns));
+
+		rtc_drift.rate_ppb = rtc_drift.estimates ?
+		                     (3 * rtc_drift.rate_ppb + rate) / 4 : rate;
+		rtc_drift.estimates++;
+	}
+
+	g_rec_mutex_unlock(&state_lock);
+
+	return true;
+}
+
+/**
+* @brief Start measuring from the next sample again, e.g. because the
+* wall clock was set. The drift rate found so far is kept.
+*/
+
+void
+rtc_drift_reanchor(void)
+{
+	g_rec_mutex_lock(&state_lock);
+	rtc_drift.anchored = false;
+	g_rec_mutex_unlock(&state_lock);
+}
+
+/**
+* @brief Current drift model: RTC minus wall time at the last sample and
+* how fast that difference grows, in ns per s.
+*
+* @retval false if the RTC has not been sampled yet
+*/
+
+bool
+rtc_drift_model(int64_t *offset_ns, int64_t *rate_ppb)
+{
+	bool measured;
+
+	g_rec_mutex_lock(&state_lock);
+
+	if (offset_ns)
+	{
+		*offset_ns = rtc_drift.diff_ns;
+	}
+
+	if (rate_ppb)
+	{
+		*rate_ppb = rtc_drift.rate_ppb;
+	}
+
+	measured = rtc_drift.measured;
+	g_rec_mutex_unlock(&state_lock);
+
+	return measured;
+}
+
+/**
+* @brief How much earlier than its expiry a wakeup delta_ns ahead has to
+* be armed so that a slow RTC does not make it late.
+*/
+
+int64_t
+rtc_drift_lead_ns(int64_t delta_ns)
+{
+	gint64 rate;
+
+	g_rec_mutex_lock(&state_lock);
+	rate = rtc_drift.rate_ppb;
+	g_rec_mutex_unlock(&state_lock);
+
+	if (rate >= 0 || delta_ns <= 0)
+	{
+		return 0;
+	}
+
+	return (gint64)((double)delta_ns * (double)-rate / 1e9);
+}
+
+/**
+* @brief Translate a wall time into the RTC time it corresponds to.
+*/
+
+time_t
+rtc_from_wall(time_t wall)
+{
+	gint64 ns;
+	bool measured;
+
+	g_rec_mutex_lock(&state_lock);
+	measured = rtc_drift.measured;
+	ns = rtc_drift.diff_ns;
+	g_rec_mutex_unlock(&state_lock);
+
+	if (!measured)
+	{
+		return wall;
+	}
+
+	/* The RTC read was truncated to the second, so the real offset lies
+	 * half a second above the measured one on average. Rounding that to
+	 * the nearest second is flooring the measured one plus a second. */
+	ns += NSEC_PER_SEC;
+
+	return wall + (time_t)((ns - (ns < 0 ? NSEC_PER_SEC - 1 : 0)) / NSEC_PER_SEC);
+}
+
 /**
 * @brief Sets an rtc alarm to fire.
 *
-* Alarm expiry will be floored at 2 seconds in the future
-* (i.e. if expiry = now + 1, alarm will fire at now + 2).
+* The rtc only has a resolution of seconds, so alarm expiry will be
+* floored at the next rtc second (i.e. if expiry = now, alarm will
+* fire at now + 1).
 *
 * @param  expiry
 *
 * @retval
-i*/
+*/
 
 
 bool
@@ -316,28 +749,15 @@ rtc_set_alarm_time(time_t expiry)
 	time_t now = 0;
 	struct tm tm_time;
 	struct rtc_wkalrm alarm;
-	static time_t curr_expiry = 0;
-
-	if (expiry == curr_expiry)
-	{
-		return true;
-	}
-	else
-	{
-		curr_expiry = expiry;
-	}
 
 	rtc_time(&now);
 
-	if (expiry < now + 2)
+	if (expiry < now + 1)
 	{
-		g_debug("%s: expiry = now + 2", __FUNCTION__);
-		expiry = now + 2;
+		g_debug("%s: expiry = now + 1", __FUNCTION__);
+		expiry = now + 1;
 	}
 
-	/* Make sure we really wake up when in deep sleep */
-	android_alarm_set(expiry);
-
 	gmtime_r(&expiry, &tm_time);
 	tm_to_rtc_wkalrm(&tm_time, &alarm);
 
@@ -361,6 +781,7 @@ rtc_set_alarm(struct rtc_wkalrm *alarm)
 		return false;
 	}
 
+	syscall_stats_inc(SYSCALL_RTC_WKALM_SET);
 	int32_t ret = ioctl(rtc_fd, RTC_WKALM_SET, alarm);
 
 	if (ret < 0)
@@ -372,9 +793,12 @@ rtc_set_alarm(struct rtc_wkalrm *alarm)
 			g_critical("Alarm IRQs not supported.");
 		}
 
+		rtc_programmed.enabled = 0;
 		return false;
 	}
 
+	rtc_programmed = *alarm;
+
 	return true;
 #else
 	return false;
@@ -395,6 +819,7 @@ rtc_read_alarm(struct rtc_wkalrm *alarm)
 		return false;
 	}
 
+	syscall_stats_inc(SYSCALL_RTC_WKALM_RD);
 	int32_t ret = ioctl(rtc_fd, RTC_WKALM_RD, alarm);
 
 	if (ret < 0)
@@ -437,6 +862,9 @@ rtc_read_alarm_time(time_t *time)
 
 /**
 * @brief Clear the RTC alarm, if its set.
+*
+* If we programmed the alarm ourselves it is disabled with the values we
+* wrote, saving the RTC_WKALM_RD.
 */
 
 bool
@@ -446,13 +874,21 @@ rtc_clear_alarm(void)
 	int32_t ret;
 	struct rtc_wkalrm alarm;
 
-	rtc_read_alarm(&alarm);
+	if (rtc_programmed.enabled)
+	{
+		alarm = rtc_programmed;
+	}
+	else
+	{
+		rtc_read_alarm(&alarm);
+	}
 
 	if (alarm.enabled)
 	{
 		g_debug("%s: clearing...", __FUNCTION__);
 
 		alarm.enabled = false;
+		syscall_stats_inc(SYSCALL_RTC_WKALM_SET);
 		ret = ioctl(rtc_fd, RTC_WKALM_SET, &alarm);
 
 		if (ret < 0)
@@ -473,6 +909,7 @@ rtc_clear_alarm(void)
 			alarm.time.tm_yday = 72;
 			alarm.time.tm_isdst = 0;
 
+			syscall_stats_inc(SYSCALL_RTC_WKALM_SET);
 			ret = ioctl(rtc_fd, RTC_WKALM_SET, &alarm);
 
 			if (ret < 0)
@@ -483,7 +920,7 @@ rtc_clear_alarm(void)
 		}
 	}
 
-	android_alarm_clear();
+	rtc_programmed.enabled = 0;
 
 	return true;
 error:
@@ -505,6 +942,7 @@ rtc_check_alarm()
 	unsigned long data;
 	int32_t ret;
 
+	syscall_stats_inc(SYSCALL_RTC_READ);
 	ret = read(rtc_fd, &data, sizeof(unsigned long));
 
 	if (ret < 0)
@@ -513,7 +951,9 @@ rtc_check_alarm()
 	}
 	else if (data & RTC_AF)
 	{
-		rtc_clear_alarm();
+		/* The rtc core disables a fired alarm itself; whoever handles
+		 * the event re-arms or clears it as needed. */
+		rtc_programmed.enabled = 0;
 		return true;
 	}
 	else
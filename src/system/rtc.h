@@ -27,9 +27,11 @@
 #define _RTC_H_
 
 #include <linux/rtc.h>
+#include <stdint.h>
 
 typedef void (*RtcAlarmFunc)(void);
 
+void rtc_set_device(const char *path);
 bool rtc_open();
 void rtc_close();
 bool rtc_add_watch(RtcAlarmFunc func);
@@ -45,8 +47,16 @@ bool rtc_clear_alarm();
 bool rtc_read_alarm(struct rtc_wkalrm *alarm);
 bool rtc_read_alarm_time(time_t *time);
 time_t rtc_time(time_t *time);
+void rtc_cache_configure(long interval, bool audit);
+void rtc_cache_invalidate(void);
+void rtc_cache_drift(time_t *last, time_t *max);
 bool rtc_read(struct tm *rtc_tm);
 bool rtc_write(struct tm *tm_time);
 bool wall_rtc_diff(time_t *ret_delta);
+bool rtc_drift_sample(void);
+void rtc_drift_reanchor(void);
+bool rtc_drift_model(int64_t *offset_ns, int64_t *rate_ppb);
+int64_t rtc_drift_lead_ns(int64_t delta_ns);
+time_t rtc_from_wall(time_t wall);
 
 #endif
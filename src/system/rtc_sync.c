@@ -0,0 +1,307 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************************************
+* @file rtc_sync.c
+*
+* @brief Keep the RTC in line with the wall clock. Writes to the RTC
+* are slow, so it is only written once it is off by more than a
+* threshold, and only from paths where the delay does not hurt: when
+* going to suspend, on shutdown and some time after the wall clock was
+* set, never while delivering alarms. The write waits for a wall clock
+* second to start, so the delayed write is done on a thread of its own
+* rather than on the main loop.
+*******************************************************************
+*/
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#include <glib.h>
+#include "rtc.h"
+#include "rtc_sync.h"
+#include "timespec.h"
+#include "wakeup.h"
+#include "dispatch.h"
+
+/**
+ * @addtogroup RTCAlarms
+ * @{
+ */
+
+static long threshold = 0;
+static long idle_delay = 0;
+static bool pending = false;
+static guint idle_source = 0;
+static GThread *sync_thread = NULL;
+static bool sync_busy = false;
+static guint writes = 0;
+
+/**
+* @brief Set the threshold in seconds, 0 turns syncing off.
+*
+* @param delay seconds after the need for a write was noticed that it
+* is done if nothing else did it first, 0 to only write on suspend and
+* shutdown
+*/
+
+void
+rtc_sync_configure(long max_diff, long delay)
+{
+	threshold = MAX(max_diff, 0);
+	idle_delay = MAX(delay, 0);
+}
+
+static gpointer
+rtc_sync_worker(gpointer data)
+{
+	rtc_sync_flush(false);
+
+	dispatch_lock();
+	sync_busy = false;
+	dispatch_unlock();
+
+	return NULL;
+}
+
+static gboolean
+rtc_sync_idle(gpointer data)
+{
+	GThread *done;
+
+	dispatch_lock();
+
+	if (sync_busy)
+	{
+		/* the last write is still waiting for its second, look again */
+		idle_source = g_timeout_add(1000, rtc_sync_idle, NULL);
+		dispatch_unlock();
+		return FALSE;
+	}
+
+	idle_source = 0;
+	sync_busy = true;
+	done = sync_thread;
+	sync_thread = NULL;
+	dispatch_unlock();
+
+	/* it has finished already, only its thread is left */
+	if (done)
+	{
+		g_thread_join(done);
+	}
+
+	done = g_thread_new("nyx-rtc-sync", rtc_sync_worker, NULL);
+
+	dispatch_lock();
+	sync_thread = done;
+	dispatch_unlock();
+
+	return FALSE;
+}
+
+/**
+* @brief Mark a write as wanted and schedule it.
+*
+* The timeout is set to end just before a wall clock second starts, so
+* the write barely has to wait for it.
+*/
+
+static void
+rtc_sync_schedule(void)
+{
+	struct timespec now;
+	guint ms;
+
+	dispatch_lock();
+	pending = true;
+
+	if (idle_delay > 0 && !idle_source)
+	{
+		clock_gettime(CLOCK_REALTIME, &now);
+		ms = (NSEC_PER_SEC - now.tv_nsec) / 1000000;
+		idle_source = g_timeout_add(idle_delay * 1000 + ms, rtc_sync_idle, NULL);
+	}
+
+	dispatch_unlock();
+}
+
+/**
+* @brief Look at the last drift sample and schedule a write if the RTC
+* is off by the threshold or more. Does not touch the RTC.
+*/
+
+void
+rtc_sync_check(void)
+{
+	int64_t offset;
+
+	if (!threshold || !rtc_drift_model(&offset, NULL))
+	{
+		return;
+	}
+
+	if (ABS(offset) >= (int64_t)threshold * NSEC_PER_SEC)
+	{
+		rtc_sync_schedule();
+	}
+}
+
+/**
+* @brief The wall clock was set, most likely corrected by NTP; the RTC
+* is probably off now, rtc_sync_flush() finds out.
+*/
+
+void
+rtc_sync_clock_set(void)
+{
+	if (threshold)
+	{
+		rtc_sync_schedule();
+	}
+}
+
+/**
+* @brief Write the RTC if a write was scheduled and it is still off by
+* the threshold.
+*
+* @param force read the RTC to check even if no write was scheduled,
+* for when there will be no later chance such as on shutdown
+*
+* The RTC counts whole seconds from the moment it is written, so the
+* write waits for the next wall clock second to start; this can take up
+* to a second, so it is not to be called from the main loop.
+*
+* @retval true if the RTC was written
+*/
+
+bool
+rtc_sync_flush(bool force)
+{
+	struct timespec now, next;
+	struct tm tm;
+	time_t delta;
+	bool written;
+
+	if (!threshold)
+	{
+		return false;
+	}
+
+	dispatch_lock();
+
+	if (!pending && !force)
+	{
+		dispatch_unlock();
+		return false;
+	}
+
+	pending = false;
+
+	if (idle_source)
+	{
+		g_source_remove(idle_source);
+		idle_source = 0;
+	}
+
+	dispatch_unlock();
+
+	if (!wall_rtc_diff(&delta) || ABS(delta) < threshold)
+	{
+		return false;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	next.tv_sec = now.tv_sec + 1;
+	next.tv_nsec = 0;
+
+	while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &next, NULL) == EINTR)
+	{
+	}
+
+	if (!gmtime_r(&next.tv_sec, &tm))
+	{
+		return false;
+	}
+
+	/* RTC alarms were programmed for the old RTC time */
+	dispatch_lock();
+	written = rtc_write(&tm);
+
+	if (written)
+	{
+		writes++;
+
+		if (wakeup_programs_rtc())
+		{
+			wakeup_resync();
+		}
+	}
+
+	dispatch_unlock();
+
+	if (written)
+	{
+		g_message("RTC was off by %ld s, set it to the wall clock", (long)delta);
+	}
+
+	return written;
+}
+
+/**
+* @brief Number of times the RTC was written.
+*/
+
+guint
+rtc_sync_writes(void)
+{
+	return writes;
+}
+
+/**
+* @brief Drop a scheduled write, e.g. because the module is closed, and
+* wait for one in progress.
+*/
+
+void
+rtc_sync_release(void)
+{
+	GThread *thread;
+
+	dispatch_lock();
+
+	if (idle_source)
+	{
+		g_source_remove(idle_source);
+		idle_source = 0;
+	}
+
+	pending = false;
+	thread = sync_thread;
+	sync_thread = NULL;
+	dispatch_unlock();
+
+	if (thread)
+	{
+		g_thread_join(thread);
+	}
+}
+
+/* @} END OF RTCAlarms */
@@ -0,0 +1,38 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************
+* @file rtc_sync.h
+*******************************************
+*/
+
+#ifndef _RTC_SYNC_H_
+#define _RTC_SYNC_H_
+
+#include <stdbool.h>
+#include <glib.h>
+
+void rtc_sync_configure(long max_diff, long delay);
+void rtc_sync_check(void);
+void rtc_sync_clock_set(void);
+bool rtc_sync_flush(bool force);
+guint rtc_sync_writes(void);
+void rtc_sync_release(void);
+
+#endif
@@ -0,0 +1,509 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************************************
+* @file suspend.c
+*
+* @brief Suspend state machine. A cycle runs on a worker thread of its
+* own, so whoever asked for it is not blocked while the kernel
+* suspends:
+*
+*   IDLE -> PREPARE -> ENTER -> RESUMED
+*               |         |
+*               +---------+---> ABORTED
+*
+* A cycle is aborted if that was requested before ENTER was reached,
+* or if the kernel refused to suspend. Either way the mode is told the
+* cycle is over and the resume hook runs before completion is
+* reported, and the time spent in each phase is recorded.
+*
+* How the kernel is asked to suspend depends on the mode: through
+* libsuspend, or directly through /sys/power (see suspend_sysfs.c).
+* Modes that leave suspending to the kernel (autosleep) stay in ENTER
+* until the cycle is ended with suspend_abort(). The kernel suspends and
+* resumes on its own meanwhile; each resume is picked up through
+* suspend_clock_set(), runs the resume hook and is recorded as a cycle
+* of its own, while the cycle handing over to the kernel is not.
+*******************************************************************
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <libsuspend.h>
+#include "suspend.h"
+#include "power_stats.h"
+#include "timespec.h"
+
+/* time CLOCK_BOOTTIME must have run ahead of CLOCK_MONOTONIC for a clock
+ * change to be taken for a resume */
+#define SUSPEND_MIN_SLEEP_NS 1000000
+
+/**
+ * @addtogroup RTCAlarms
+ * @{
+ */
+
+static GMutex suspend_mutex;
+static GCond suspend_cond;
+static GThread *worker = NULL;
+
+static system_suspend_cycle_t cycle = { .state = SYSTEM_SUSPEND_IDLE };
+static bool abort_requested = false;
+static bool handed_over = false;
+static bool clock_changed = false;
+static bool avoided = false;
+static bool running = false;
+
+static const struct suspend_mode *modes[] =
+{
+	&suspend_libsuspend_mode,
+	&suspend_wakeup_count_mode,
+	&suspend_autosleep_mode,
+};
+
+static const struct suspend_mode *mode = &suspend_libsuspend_mode;
+
+static SuspendHook before_hook = NULL;
+static SuspendHook after_hook = NULL;
+static SuspendDoneFunc done_func = NULL;
+static void *done_data = NULL;
+
+static int64_t
+clock_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+
+	return timespec_to_ns(&ts);
+}
+
+/**
+* @brief Set what runs right before a cycle prepares and right after it
+* ends, resumed or not.
+*/
+
+void
+suspend_configure(SuspendHook before, SuspendHook after)
+{
+	before_hook = before;
+	after_hook = after;
+}
+
+/**
+* @brief Select the suspend mode by name. Not to be called while a cycle
+* is running.
+*
+* @retval false if there is no such mode, the current one is kept
+*/
+
+bool
+suspend_set_mode(const char *name)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(modes); i++)
+	{
+		if (!strcmp(modes[i]->name, name))
+		{
+			mode = modes[i];
+			g_message("Using %s suspend mode", mode->name);
+			return true;
+		}
+	}
+
+	g_warning("%s: unknown suspend mode %s, using %s", __FUNCTION__, name,
+	          mode->name);
+
+	return false;
+}
+
+static bool
+libsuspend_prepare(void)
+{
+	libsuspend_prepare_suspend();
+
+	return true;
+}
+
+static bool
+libsuspend_enter(void)
+{
+	return libsuspend_enter_suspend() == 0;
+}
+
+static void
+libsuspend_exit(void)
+{
+	libsuspend_exit_suspend();
+}
+
+const struct suspend_mode suspend_libsuspend_mode =
+{
+	.name = "libsuspend",
+	.prepare = libsuspend_prepare,
+	.enter = libsuspend_enter,
+	.exit = libsuspend_exit,
+};
+
+/**
+* @brief With autosleep, see whether the kernel suspended since asleep
+* was last taken and if so run the resume hook and record the cycle.
+*
+* @param asleep how far CLOCK_BOOTTIME was ahead of CLOCK_MONOTONIC
+* after the last resume, updated
+*/
+
+static void
+kernel_resumed(int64_t *asleep)
+{
+	system_suspend_cycle_t resumed = { .state = SYSTEM_SUSPEND_RESUMED };
+	int64_t now = clock_ns(CLOCK_BOOTTIME) - clock_ns(CLOCK_MONOTONIC);
+	int64_t start;
+
+	/* the wall clock was set, the device did not suspend */
+	if (now - *asleep < SUSPEND_MIN_SLEEP_NS)
+	{
+		return;
+	}
+
+	/* the kernel does not tell how long it took to get there */
+	resumed.enter_ns = resumed.suspended_ns = now - *asleep;
+	*asleep = now;
+
+	start = clock_ns(CLOCK_BOOTTIME);
+
+	if (after_hook)
+	{
+		after_hook();
+	}
+
+	resumed.resume_ns = clock_ns(CLOCK_BOOTTIME) - start;
+	power_stats_cycle(&resumed);
+
+	g_debug("%s: suspended %" G_GINT64_FORMAT "us, resume %" G_GINT64_FORMAT "us",
+	        __FUNCTION__, (gint64)resumed.suspended_ns / 1000,
+	        (gint64)resumed.resume_ns / 1000);
+}
+
+static gpointer
+suspend_run(gpointer data)
+{
+	int64_t start, mono, boot;
+	int64_t enter = 0, suspended = 0, asleep;
+	bool aborted, handed = false;
+	SuspendDoneFunc done;
+	void *ctx;
+
+	start = clock_ns(CLOCK_BOOTTIME);
+
+	if (before_hook)
+	{
+		before_hook();
+	}
+
+	aborted = !mode->prepare();
+
+	g_mutex_lock(&suspend_mutex);
+	cycle.prepare_ns = clock_ns(CLOCK_BOOTTIME) - start;
+	aborted = aborted || abort_requested;
+
+	if (!aborted)
+	{
+		cycle.state = SYSTEM_SUSPEND_ENTER;
+	}
+
+	g_mutex_unlock(&suspend_mutex);
+
+	if (!aborted)
+	{
+		/* CLOCK_MONOTONIC stops while suspended, CLOCK_BOOTTIME does not */
+		mono = clock_ns(CLOCK_MONOTONIC);
+		boot = clock_ns(CLOCK_BOOTTIME);
+		aborted = !mode->enter();
+
+		if (!aborted && mode->until_resume)
+		{
+			asleep = clock_ns(CLOCK_BOOTTIME) - clock_ns(CLOCK_MONOTONIC);
+			handed = true;
+
+			g_mutex_lock(&suspend_mutex);
+			handed_over = true;
+			clock_changed = false;
+			g_cond_broadcast(&suspend_cond);
+
+			/* both are checked before every wait, a change signalled
+			 * while the resume hook ran is not left for later */
+			while (!abort_requested)
+			{
+				if (clock_changed)
+				{
+					clock_changed = false;
+					g_mutex_unlock(&suspend_mutex);
+					kernel_resumed(&asleep);
+					g_mutex_lock(&suspend_mutex);
+					continue;
+				}
+
+				g_cond_wait(&suspend_cond, &suspend_mutex);
+			}
+
+			g_mutex_unlock(&suspend_mutex);
+		}
+
+		enter = clock_ns(CLOCK_BOOTTIME) - boot;
+		suspended = MAX(enter - (clock_ns(CLOCK_MONOTONIC) - mono), 0);
+	}
+
+	start = clock_ns(CLOCK_BOOTTIME);
+	mode->exit();
+
+	if (after_hook)
+	{
+		after_hook();
+	}
+
+	g_mutex_lock(&suspend_mutex);
+	cycle.enter_ns = enter;
+	cycle.suspended_ns = suspended;
+	cycle.resume_ns = clock_ns(CLOCK_BOOTTIME) - start;
+	cycle.state = aborted ? SYSTEM_SUSPEND_ABORTED : SYSTEM_SUSPEND_RESUMED;
+	done = done_func;
+	ctx = done_data;
+	g_mutex_unlock(&suspend_mutex);
+
+	/* the kernel's own cycles were recorded as they resumed, and one
+	 * avoided was never really attempted */
+	if (!handed && !(aborted && avoided))
+	{
+		power_stats_cycle(&cycle);
+	}
+
+	g_debug("%s: %s, prepare %" G_GINT64_FORMAT "us enter %" G_GINT64_FORMAT
+	        "us (suspended %" G_GINT64_FORMAT "us) resume %" G_GINT64_FORMAT "us",
+	        __FUNCTION__, aborted ? "aborted" : "resumed",
+	        (gint64)cycle.prepare_ns / 1000, (gint64)cycle.enter_ns / 1000,
+	        (gint64)cycle.suspended_ns / 1000, (gint64)cycle.resume_ns / 1000);
+
+	if (done)
+	{
+		done(!aborted, ctx);
+	}
+
+	g_mutex_lock(&suspend_mutex);
+	running = false;
+	g_cond_broadcast(&suspend_cond);
+	g_mutex_unlock(&suspend_mutex);
+
+	return NULL;
+}
+
+/**
+* @brief Start a suspend cycle.
+*
+* @param done called from the worker once the cycle is over, with
+* whether the device actually suspended; NULL to wait for the cycle
+* here instead, or for autosleep to be enabled. It must not start
+* another cycle itself.
+* @param resumed set when waiting, to whether the device suspended or
+* autosleep was enabled
+*
+* @retval false if a cycle is running already
+*/
+
+bool
+suspend_start(SuspendDoneFunc done, void *data, bool *resumed)
+{
+	g_mutex_lock(&suspend_mutex);
+
+	if (running)
+	{
+		g_mutex_unlock(&suspend_mutex);
+		return false;
+	}
+
+	/* the previous worker is done, only its thread is left */
+	if (worker)
+	{
+		g_thread_join(worker);
+	}
+
+	running = true;
+	abort_requested = false;
+	avoided = false;
+	handed_over = false;
+	cycle.state = SYSTEM_SUSPEND_PREPARE;
+	cycle.prepare_ns = cycle.enter_ns = cycle.suspended_ns = cycle.resume_ns = 0;
+	done_func = done;
+	done_data = data;
+	worker = g_thread_new("nyx-system-suspend", suspend_run, NULL);
+
+	if (!done)
+	{
+		while (running && !handed_over)
+		{
+			g_cond_wait(&suspend_cond, &suspend_mutex);
+		}
+
+		if (resumed)
+		{
+			*resumed = cycle.state == SYSTEM_SUSPEND_RESUMED || handed_over;
+		}
+	}
+
+	g_mutex_unlock(&suspend_mutex);
+
+	return true;
+}
+
+/**
+* @brief Ask the running cycle not to suspend, or with autosleep to stop
+* suspending.
+*
+* @retval true if it will not, false if no cycle is running or it has
+* already entered suspend
+*/
+
+bool
+suspend_abort(void)
+{
+	bool ret;
+
+	g_mutex_lock(&suspend_mutex);
+	ret = running && (cycle.state == SYSTEM_SUSPEND_PREPARE ||
+	                  (mode->until_resume && cycle.state == SYSTEM_SUSPEND_ENTER));
+
+	if (ret)
+	{
+		abort_requested = true;
+		g_cond_broadcast(&suspend_cond);
+	}
+
+	g_mutex_unlock(&suspend_mutex);
+
+	return ret;
+}
+
+/**
+* @brief Abort the cycle being prepared because suspending is not worth
+* it. Unlike suspend_abort() it is not recorded as a cycle, the caller
+* accounts for it as avoided.
+*
+* @retval true if it will not suspend, false if no cycle is being
+* prepared
+*/
+
+bool
+suspend_avoid(void)
+{
+	bool ret;
+
+	g_mutex_lock(&suspend_mutex);
+	ret = running && cycle.state == SYSTEM_SUSPEND_PREPARE;
+
+	if (ret)
+	{
+		abort_requested = true;
+		avoided = true;
+		g_cond_broadcast(&suspend_cond);
+	}
+
+	g_mutex_unlock(&suspend_mutex);
+
+	return ret;
+}
+
+bool
+suspend_running(void)
+{
+	bool ret;
+
+	g_mutex_lock(&suspend_mutex);
+	ret = running;
+	g_mutex_unlock(&suspend_mutex);
+
+	return ret;
+}
+
+/**
+* @brief The wall clock was set. The kernel reports every resume that
+* way too, which with autosleep is the only sign of it having suspended
+* on its own; the worker is woken up to look.
+*/
+
+void
+suspend_clock_set(void)
+{
+	g_mutex_lock(&suspend_mutex);
+
+	if (handed_over && running)
+	{
+		clock_changed = true;
+		g_cond_broadcast(&suspend_cond);
+	}
+
+	g_mutex_unlock(&suspend_mutex);
+}
+
+/**
+* @brief The cycle running or, if none is, the last one.
+*/
+
+void
+suspend_last_cycle(system_suspend_cycle_t *last)
+{
+	g_mutex_lock(&suspend_mutex);
+	*last = cycle;
+	g_mutex_unlock(&suspend_mutex);
+}
+
+/**
+* @brief Wait for a running cycle to end and the worker to go away,
+* turning autosleep off if it is on.
+*/
+
+void
+suspend_release(void)
+{
+	g_mutex_lock(&suspend_mutex);
+
+	if (handed_over)
+	{
+		abort_requested = true;
+		g_cond_broadcast(&suspend_cond);
+	}
+
+	while (running)
+	{
+		g_cond_wait(&suspend_cond, &suspend_mutex);
+	}
+
+	if (worker)
+	{
+		g_thread_join(worker);
+		worker = NULL;
+	}
+
+	g_mutex_unlock(&suspend_mutex);
+}
+
+/* @} END OF RTCAlarms */
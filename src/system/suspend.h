@@ -0,0 +1,65 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************
+* @file suspend.h
+*******************************************
+*/
+
+#ifndef _SUSPEND_H_
+#define _SUSPEND_H_
+
+#include <stdbool.h>
+#include "system.h"
+
+typedef void (*SuspendHook)(void);
+typedef void (*SuspendDoneFunc)(bool resumed, void *data);
+
+/**
+ * How the kernel is asked to suspend. @prepare runs before ENTER and
+ * may refuse the cycle, @enter returns once the device has resumed or
+ * with false if it did not suspend, and @exit ends every cycle.
+ * @until_resume marks modes whose @enter only hands suspending over to
+ * the kernel, which then goes on until suspend_abort().
+ */
+struct suspend_mode
+{
+	const char *name;
+	bool until_resume;
+	bool (*prepare)(void);
+	bool (*enter)(void);
+	void (*exit)(void);
+};
+
+extern const struct suspend_mode suspend_libsuspend_mode;
+extern const struct suspend_mode suspend_wakeup_count_mode;
+extern const struct suspend_mode suspend_autosleep_mode;
+
+void suspend_configure(SuspendHook before, SuspendHook after);
+bool suspend_set_mode(const char *name);
+void suspend_sysfs_set_root(const char *root);
+bool suspend_start(SuspendDoneFunc done, void *data, bool *resumed);
+bool suspend_abort(void);
+bool suspend_avoid(void);
+bool suspend_running(void);
+void suspend_clock_set(void);
+void suspend_last_cycle(system_suspend_cycle_t *last);
+void suspend_release(void);
+
+#endif
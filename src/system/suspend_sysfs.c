@@ -0,0 +1,214 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+****************************************************************
+* @file suspend_sysfs.c
+*
+* @brief Suspend modes that talk to /sys/power directly.
+*
+* wakeup_count closes the race between deciding to suspend and the
+* kernel suspending: the count of wakeup events is read when the cycle
+* is prepared and written back right before suspending. If a wakeup
+* event came in in between the kernel refuses the write and the cycle
+* is aborted instead of suspending only to wake up right away.
+*
+* autosleep hands suspending over to the kernel, which suspends
+* whenever no wakeup source is active until it is turned off again.
+*
+* The directory can be moved with suspend_sysfs_set_root(), e.g. to a
+* directory of plain files standing in for /sys/power. That is how
+* tools/suspend_check.c drives both aborts: without a wakeup_count file,
+* or with one that holds no count, the cycle aborts while being
+* prepared; with wakeup_count a symlink to a read-only proc file holding
+* a number, writing the count back fails as when the kernel refuses it.
+***************************************************************
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <glib.h>
+#include "suspend.h"
+#include "syscall_stats.h"
+
+#define POWER_SYSFS "/sys/power"
+
+/**
+ * @addtogroup RTCAlarms
+ * @{
+ */
+
+static const char *power_root = POWER_SYSFS;
+static char wakeup_count[32];
+
+void
+suspend_sysfs_set_root(const char *root)
+{
+	power_root = root ? root : POWER_SYSFS;
+}
+
+static bool
+power_read(const char *attr, char *buf, size_t size)
+{
+	gchar *path = g_build_path("/", power_root, attr, NULL);
+	ssize_t len;
+	int fd;
+
+	syscall_stats_inc(SYSCALL_POWER_SYSFS);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+	{
+		g_warning("%s: could not open %s %d", __FUNCTION__, path, errno);
+		g_free(path);
+		return false;
+	}
+
+	/* wakeup_count blocks while wakeup events are being processed and
+	 * fails if a signal comes in meanwhile */
+	len = read(fd, buf, size - 1);
+	close(fd);
+
+	if (len <= 0)
+	{
+		g_debug("%s: could not read %s %d", __FUNCTION__, path, errno);
+		g_free(path);
+		return false;
+	}
+
+	buf[len] = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+	g_free(path);
+
+	return true;
+}
+
+static bool
+power_write(const char *attr, const char *value)
+{
+	gchar *path = g_build_path("/", power_root, attr, NULL);
+	size_t len = strlen(value);
+	bool ret;
+	int fd;
+
+	syscall_stats_inc(SYSCALL_POWER_SYSFS);
+	fd = open(path, O_WRONLY | O_CLOEXEC);
+
+	if (fd < 0)
+	{
+		g_warning("%s: could not open %s %d", __FUNCTION__, path, errno);
+		g_free(path);
+		return false;
+	}
+
+	ret = write(fd, value, len) == (ssize_t)len;
+
+	if (!ret)
+	{
+		g_debug("%s: writing %s to %s failed %d", __FUNCTION__, value, path, errno);
+	}
+
+	close(fd);
+	g_free(path);
+
+	return ret;
+}
+
+static bool
+wakeup_count_prepare(void)
+{
+	const char *c;
+
+	if (!power_read("wakeup_count", wakeup_count, sizeof(wakeup_count)))
+	{
+		return false;
+	}
+
+	g_strchomp(wakeup_count);
+
+	for (c = wakeup_count; g_ascii_isdigit(*c); c++);
+
+	/* anything else would only be refused when written back */
+	if (c == wakeup_count || *c)
+	{
+		g_warning("%s: wakeup_count '%s' is not a count", __FUNCTION__, wakeup_count);
+		return false;
+	}
+
+	return true;
+}
+
+static bool
+wakeup_count_enter(void)
+{
+	if (!power_write("wakeup_count", wakeup_count))
+	{
+		g_debug("%s: wakeup event since count %s, not suspending", __FUNCTION__,
+		        wakeup_count);
+		return false;
+	}
+
+	return power_write("state", "mem");
+}
+
+static void
+wakeup_count_exit(void)
+{
+}
+
+const struct suspend_mode suspend_wakeup_count_mode =
+{
+	.name = "wakeup_count",
+	.prepare = wakeup_count_prepare,
+	.enter = wakeup_count_enter,
+	.exit = wakeup_count_exit,
+};
+
+static bool
+autosleep_prepare(void)
+{
+	char state[32];
+
+	return power_read("autosleep", state, sizeof(state));
+}
+
+static bool
+autosleep_enter(void)
+{
+	return power_write("autosleep", "mem");
+}
+
+static void
+autosleep_exit(void)
+{
+	power_write("autosleep", "off");
+}
+
+const struct suspend_mode suspend_autosleep_mode =
+{
+	.name = "autosleep",
+	.until_resume = true,
+	.prepare = autosleep_prepare,
+	.enter = autosleep_enter,
+	.exit = autosleep_exit,
+};
+
+/* @} END OF RTCAlarms */
@@ -0,0 +1,122 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************************************
+* @file syscall_stats.c
+*
+* @brief Counts the device syscalls issued by the alarm path so the
+* cost of each operation can be checked on production devices.
+*******************************************************************
+*/
+
+#include <string.h>
+#include <stdint.h>
+#include <glib.h>
+#include "syscall_stats.h"
+
+static const char *const syscall_names[SYSCALL_COUNT] =
+{
+	[SYSCALL_DEV_OPEN]               = "open",
+	[SYSCALL_DEV_CLOSE]              = "close",
+	[SYSCALL_RTC_READ]               = "rtc_read",
+	[SYSCALL_RTC_RD_TIME]            = "RTC_RD_TIME",
+	[SYSCALL_RTC_WKALM_RD]           = "RTC_WKALM_RD",
+	[SYSCALL_RTC_WKALM_SET]          = "RTC_WKALM_SET",
+	[SYSCALL_RTC_SET_TIME]           = "RTC_SET_TIME",
+	[SYSCALL_ANDROID_ALARM_GET_TIME] = "ANDROID_ALARM_GET_TIME",
+	[SYSCALL_ANDROID_ALARM_SET]      = "ANDROID_ALARM_SET",
+	[SYSCALL_ANDROID_ALARM_CLEAR]    = "ANDROID_ALARM_CLEAR",
+	[SYSCALL_TIMERFD_SETTIME]        = "timerfd_settime",
+	[SYSCALL_TIMERFD_READ]           = "timerfd_read",
+	[SYSCALL_SYSFS_WRITE]            = "wakealarm_write",
+	[SYSCALL_POWER_SYSFS]            = "power_sysfs",
+};
+
+static uint64_t syscall_counts[SYSCALL_COUNT];
+
+void
+syscall_stats_inc(SyscallOp op)
+{
+	__atomic_add_fetch(&syscall_counts[op], 1, __ATOMIC_RELAXED);
+}
+
+uint64_t
+syscall_stats_get(SyscallOp op)
+{
+	return __atomic_load_n(&syscall_counts[op], __ATOMIC_RELAXED);
+}
+
+/**
+* @brief Sum of all counters, to tell how many calls a code path made.
+*/
+
+uint64_t
+syscall_stats_total(void)
+{
+	uint64_t total = 0;
+	int op;
+
+	for (op = 0; op < SYSCALL_COUNT; op++)
+	{
+		total += __atomic_load_n(&syscall_counts[op], __ATOMIC_RELAXED);
+	}
+
+	return total;
+}
+
+const char *
+syscall_stats_name(SyscallOp op)
+{
+	return syscall_names[op];
+}
+
+/**
+* @brief Map an operation name as printed by syscall_stats_dump() back
+* to its counter.
+*
+* @retval the operation, -1 if the name is unknown
+*/
+
+int
+syscall_stats_lookup(const char *name)
+{
+	int op;
+
+	for (op = 0; op < SYSCALL_COUNT; op++)
+	{
+		if (!strcmp(name, syscall_names[op]))
+		{
+			return op;
+		}
+	}
+
+	return -1;
+}
+
+void
+syscall_stats_dump(void)
+{
+	int op;
+
+	for (op = 0; op < SYSCALL_COUNT; op++)
+	{
+		g_message("syscalls: %-24s %" G_GUINT64_FORMAT, syscall_names[op],
+		          (guint64)syscall_stats_get(op));
+	}
+}
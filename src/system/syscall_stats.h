@@ -0,0 +1,56 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************
+* @file syscall_stats.h
+*******************************************
+*/
+
+#ifndef _SYSCALL_STATS_H_
+#define _SYSCALL_STATS_H_
+
+#include <stdint.h>
+
+typedef enum
+{
+	SYSCALL_DEV_OPEN,
+	SYSCALL_DEV_CLOSE,
+	SYSCALL_RTC_READ,
+	SYSCALL_RTC_RD_TIME,
+	SYSCALL_RTC_WKALM_RD,
+	SYSCALL_RTC_WKALM_SET,
+	SYSCALL_RTC_SET_TIME,
+	SYSCALL_ANDROID_ALARM_GET_TIME,
+	SYSCALL_ANDROID_ALARM_SET,
+	SYSCALL_ANDROID_ALARM_CLEAR,
+	SYSCALL_TIMERFD_SETTIME,
+	SYSCALL_TIMERFD_READ,
+	SYSCALL_SYSFS_WRITE,
+	SYSCALL_POWER_SYSFS,
+	SYSCALL_COUNT
+} SyscallOp;
+
+void syscall_stats_inc(SyscallOp op);
+uint64_t syscall_stats_get(SyscallOp op);
+uint64_t syscall_stats_total(void);
+const char *syscall_stats_name(SyscallOp op);
+int syscall_stats_lookup(const char *name);
+void syscall_stats_dump(void);
+
+#endif
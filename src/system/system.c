@@ -35,25 +35,36 @@
 #include <glib.h>
 #include <libsuspend.h>
 #include "rtc.h"
+#include "rtc_sync.h"
+#include "alarm_queue.h"
+#include "system.h"
+#include "config.h"
+#include "timespec.h"
+#include "syscall_stats.h"
+#include "latency_stats.h"
+#include "alarm_quota.h"
+#include "dispatch.h"
+#include "alarm_trace.h"
+#include "alarm_submit.h"
+#include "suspend.h"
+#include "power_stats.h"
 #include <nyx/nyx_module.h>
 #include <nyx/common/nyx_macros.h>
 #include <nyx/module/nyx_utils.h>
 #include "msgid.h"
 
 nyx_device_t *nyxDev;
-nyx_device_callback_function_t alarm_fired_callback = NULL;
+static bool next_alarm_verify = false;
+static nyx_device_callback_function_t suspend_callback = NULL;
+static void *suspend_context = NULL;
+static int64_t suspend_min_residency_ns = 0;
+
+static void system_before_suspend(void);
+static void system_after_resume(void);
 bool reformatted = false;
 
 NYX_DECLARE_MODULE(NYX_DEVICE_SYSTEM, "System");
 
-void AlarmFiredCB(void)
-{
-	if (alarm_fired_callback)
-	{
-		alarm_fired_callback(nyxDev, NYX_CALLBACK_STATUS_DONE, NULL);
-	}
-}
-
 nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 {
 	if (nyxDev)
@@ -81,14 +92,13 @@ nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 	                           NYX_SYSTEM_QUERY_RTC_TIME_MODULE_METHOD,
 	                           "system_query_rtc_time");
 
-	/*FIXME
 	nyx_module_register_method(i, (nyx_device_t *)nyxDev,
 	                           NYX_SYSTEM_SUSPEND_ASYNC_MODULE_METHOD,
 	                           "system_suspend_async");
 
 	nyx_module_register_method(i, (nyx_device_t *)nyxDev,
 	                           NYX_SYSTEM_RESUME_MODULE_METHOD,
-	                           "system_resume");*/
+	                           "system_resume");
 
 	nyx_module_register_method(i, (nyx_device_t *)nyxDev,
 	                           NYX_SYSTEM_SHUTDOWN_MODULE_METHOD,
@@ -103,6 +113,49 @@ nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 	                           "system_erase_partition");
 
 	libsuspend_init(0);
+	suspend_configure(system_before_suspend, system_after_resume);
+	suspend_sysfs_set_root(config_get_string("POWER_SYSFS", NULL));
+	suspend_set_mode(config_get_string("SUSPEND_MODE", "libsuspend"));
+	suspend_min_residency_ns = (int64_t)config_get_int("SUSPEND_MIN_RESIDENCY",
+	                           0) * 1000000;
+
+	rtc_cache_configure(config_get_int("RTC_CACHE_INTERVAL", 600),
+	                    config_get_bool("RTC_CACHE_AUDIT", false));
+	dispatch_init(config_get_bool("DISPATCH_THREAD", false));
+	next_alarm_verify = config_get_bool("NEXT_ALARM_VERIFY", false);
+	alarm_quota_configure(config_get_int("ALARM_QUOTA_BURST", 0),
+	                      config_get_int("ALARM_QUOTA_PERIOD", 60));
+
+	rtc_set_device(config_get_string("RTC_DEVICE", NULL));
+	rtc_sync_configure(config_get_int("RTC_SYNC_THRESHOLD", 0),
+	                   config_get_int("RTC_SYNC_DELAY", 300));
+
+	/* the simulated backend runs on virtual clocks, replays must not
+	 * depend on the host RTC */
+	if (g_strcmp0(config_get_string("WAKEUP_BACKEND", NULL), "sim") != 0 &&
+	    rtc_open())
+	{
+		rtc_drift_sample();
+		rtc_sync_check();
+	}
+
+	/* on the main loop the request would only wait for the caller's
+	 * own thread */
+	if (config_get_bool("ASYNC_SET_ALARM", false))
+	{
+		if (dispatch_threaded())
+		{
+			alarm_submit_init();
+		}
+		else
+		{
+			g_warning("ASYNC_SET_ALARM needs DISPATCH_THREAD, setting alarms synchronously");
+		}
+	}
+
+	/* Without a wakeup backend alarms cannot be set, everything else
+	 * keeps working. */
+	alarm_queue_init(nyxDev);
 
 	*d = (nyx_device_t *)nyxDev;
 	return NYX_ERROR_NONE;
@@ -110,50 +163,366 @@ nyx_error_t nyx_module_open(nyx_instance_t i, nyx_device_t **d)
 
 nyx_error_t nyx_module_close(nyx_device_t *d)
 {
+	suspend_release();
+	alarm_submit_release();
+	/* the sync thread writes the RTC through the wakeup backend, it must
+	 * be gone before the backend is closed */
+	rtc_sync_release();
+	alarm_queue_release();
 	rtc_close();
+	dispatch_shutdown();
 	return NYX_ERROR_NONE;
 }
 
 nyx_error_t system_set_alarm(nyx_device_handle_t handle, time_t time,
                              nyx_device_callback_function_t callback_func, void *context)
+{
+	struct timespec expiry = { .tv_sec = time, .tv_nsec = 0 };
+
+	return system_set_alarm_timespec(handle, &expiry, callback_func, context);
+}
+
+/**
+* @brief Set a wall clock alarm with nanosecond resolution.
+*
+* Backends that support it (timerfd, Android alarm driver) fire at the
+* exact time, the rtc ones at the next full second. A NULL or zero time
+* cancels the alarm set with the same callback and context.
+*/
+
+nyx_error_t system_set_alarm_timespec(nyx_device_handle_t handle,
+                                      const struct timespec *time,
+                                      nyx_device_callback_function_t callback_func,
+                                      void *context)
 {
 	if (handle != nyxDev)
 	{
 		return NYX_ERROR_INVALID_HANDLE;
 	}
 
-	if (rtc_open() == 0)
+	if (alarm_submit_enabled())
+	{
+		struct timespec none = { 0, 0 };
+
+		/* applied later on the dispatcher, the newest request wins */
+		return alarm_submit(ALARM_CLOCK_REALTIME, time ? time : &none,
+		                    callback_func, context) ?
+		       NYX_ERROR_NONE : NYX_ERROR_OUT_OF_MEMORY;
+	}
+
+	/* Every callback/context pair owns one alarm in the queue, so
+	 * several clients can have an alarm pending at the same time. */
+	if (!time || !timespec_is_set(time))
+	{
+		alarm_queue_cancel(ALARM_CLOCK_REALTIME, callback_func, context);
+	}
+	else if (alarm_queue_set(ALARM_CLOCK_REALTIME, time, callback_func,
+	                         context) == 0)
+	{
+		return NYX_ERROR_INVALID_OPERATION;
+	}
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+* @brief Set an alarm that may fire anywhere between earliest and latest.
+*
+* The module is free to deliver it together with any other alarm whose
+* window overlaps, so several clients can share one hardware wakeup.
+* Like system_set_alarm() the alarm replaces any earlier one set with
+* the same callback and context.
+*/
+
+nyx_error_t system_set_alarm_range(nyx_device_handle_t handle, time_t earliest,
+                                   time_t latest,
+                                   nyx_device_callback_function_t callback_func,
+                                   void *context)
+{
+	struct timespec start = { .tv_sec = earliest, .tv_nsec = 0 };
+	struct timespec end = { .tv_sec = latest, .tv_nsec = 0 };
+
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!earliest || latest < earliest)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	/* an older system_set_alarm() still queued must not overtake this */
+	alarm_submit_flush();
+
+	if (alarm_queue_set_range(ALARM_CLOCK_REALTIME, &start, &end,
+	                          callback_func, context) == 0)
+	{
+		return NYX_ERROR_INVALID_OPERATION;
+	}
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+* @brief Set a wakeup alarm on the boot clock (CLOCK_BOOTTIME).
+*
+* The expiry is an absolute boot clock time, so the alarm is not moved
+* when the wall clock is changed. A NULL or zero time cancels the boot
+* clock alarm set with the same callback and context.
+*/
+
+nyx_error_t system_set_alarm_elapsed(nyx_device_handle_t handle,
+                                     const struct timespec *time,
+                                     nyx_device_callback_function_t callback_func,
+                                     void *context)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!time || !timespec_is_set(time))
+	{
+		alarm_queue_cancel(ALARM_CLOCK_BOOTTIME, callback_func, context);
+	}
+	else if (alarm_queue_set(ALARM_CLOCK_BOOTTIME, time, callback_func,
+	                         context) == 0)
+	{
+		return NYX_ERROR_INVALID_OPERATION;
+	}
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+* @brief Set a wall clock alarm that does not wake the device.
+*
+* While the device is awake it fires at the given time; during suspend
+* it is held back and delivered with the next wakeup alarm or resume,
+* whichever comes first. A NULL or zero time cancels it. The alarm
+* shares its slot with system_set_alarm(), so setting either kind for
+* the same callback and context replaces the other.
+*/
+
+nyx_error_t system_set_alarm_nonwakeup(nyx_device_handle_t handle,
+                                       const struct timespec *time,
+                                       nyx_device_callback_function_t callback_func,
+                                       void *context)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	alarm_submit_flush();
+
+	if (!time || !timespec_is_set(time))
+	{
+		alarm_queue_cancel(ALARM_CLOCK_REALTIME, callback_func, context);
+	}
+	else if (alarm_queue_set_nonwakeup(ALARM_CLOCK_REALTIME, time, time,
+	                                   callback_func, context) == 0)
+	{
+		return NYX_ERROR_INVALID_OPERATION;
+	}
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+* @brief Set a wall clock alarm that fires at first and then every
+* interval until it is cancelled with system_set_alarm(handle, 0, ...)
+* or replaced by another alarm of the same callback and context.
+*
+* With phase_aligned every expiry stays at first + n * interval and
+* periods missed while the callback was late are skipped; otherwise the
+* next period is counted from when the callback runs.
+*/
+
+nyx_error_t system_set_alarm_periodic(nyx_device_handle_t handle,
+                                      const struct timespec *first,
+                                      const struct timespec *interval,
+                                      bool phase_aligned,
+                                      nyx_device_callback_function_t callback_func,
+                                      void *context)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!first || !timespec_is_set(first) || !interval ||
+	    timespec_to_ns(interval) <= 0)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	alarm_submit_flush();
+
+	if (alarm_queue_set_periodic(ALARM_CLOCK_REALTIME, first, interval,
+	                             phase_aligned, callback_func, context) == 0)
+	{
+		return NYX_ERROR_INVALID_OPERATION;
+	}
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+* @brief Queue a wall clock alarm without a callback of its own.
+*
+* Unlike system_set_alarm() any number of these can be pending. They are
+* identified by the returned id and reported through the callback set
+* with system_set_alarm_batch_callback(), which gets every alarm that
+* expired in one pass in a single call.
+*/
+
+nyx_error_t system_add_alarm(nyx_device_handle_t handle,
+                             const struct timespec *time, unsigned int *id)
+{
+	guint added;
+
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!time || !timespec_is_set(time))
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	added = alarm_queue_add(ALARM_CLOCK_REALTIME, time, NULL, NULL);
+
+	if (added == 0)
 	{
 		return NYX_ERROR_INVALID_OPERATION;
 	}
 
+	if (id)
+	{
+		*id = added;
+	}
+
+	return NYX_ERROR_NONE;
+}
+
+nyx_error_t system_remove_alarm(nyx_device_handle_t handle, unsigned int id)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	return alarm_queue_remove(id) ? NYX_ERROR_NONE : NYX_ERROR_INVALID_VALUE;
+}
+
+/**
+* @brief Set the callback that gets the ids of all alarms delivered by one
+* wakeup at once, NULL to remove it.
+*
+* The ids cover alarms added with system_add_alarm() as well as those set
+* with a callback of their own, which still get that callback too.
+*/
+
+nyx_error_t system_set_alarm_batch_callback(nyx_device_handle_t handle,
+                                            system_alarm_batch_cb_t callback_func,
+                                            void *context)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	alarm_queue_set_batch_func(callback_func, context);
+
+	return NYX_ERROR_NONE;
+}
+
+nyx_error_t system_query_saved_wakeups(nyx_device_handle_t handle,
+                                       unsigned int *count)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!count)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	*count = alarm_queue_saved_wakeups();
+
+	return NYX_ERROR_NONE;
+}
+
+nyx_error_t system_query_next_alarm(nyx_device_handle_t handle, time_t *time)
+{
+	return system_query_next_alarm_verified(handle, next_alarm_verify, time);
+}
+
+/**
+* @brief Time of the next alarm, served from the alarm queue.
+*
+* The RTC alarm is only read when no alarm is queued, since it may have
+* been set by someone else, or when verify is set. A verified RTC alarm
+* that does not match what the queue armed has been changed from outside
+* and is programmed again.
+*/
+
+nyx_error_t system_query_next_alarm_verified(nyx_device_handle_t handle,
+                                             bool verify, time_t *time)
+{
+	struct timespec next;
+	bool queued;
+	time_t hw;
+
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
 	if (!time)
 	{
-		rtc_clear_alarm();
+		return NYX_ERROR_INVALID_VALUE;
 	}
-	else
+
+	queued = alarm_queue_next_wall(&next);
+
+	if (queued)
 	{
-		if (rtc_set_alarm_time(time) == 0)
-		{
-			return NYX_ERROR_INVALID_OPERATION;
-		}
+		*time = timespec_ceil_sec(&next);
 
-		if (callback_func)
+		if (!verify || !wakeup_programs_rtc())
 		{
-			alarm_fired_callback = callback_func;
-			rtc_add_watch(AlarmFiredCB);
-		}
-		else
-		{
-			alarm_fired_callback = NULL;
-			rtc_clear_watch();
+			return NYX_ERROR_NONE;
 		}
 	}
 
+	if (!rtc_open() || !rtc_read_alarm_time(&hw))
+	{
+		return queued ? NYX_ERROR_NONE : NYX_ERROR_INVALID_OPERATION;
+	}
+
+	if (!queued)
+	{
+		*time = hw;
+	}
+	else if (hw != *time)
+	{
+		g_warning("%s: RTC alarm %ld does not match %ld, re-arming", __FUNCTION__,
+		          (long)hw, (long)*time);
+		dispatch_lock();
+		wakeup_resync();
+		dispatch_unlock();
+	}
+
 	return NYX_ERROR_NONE;
 }
 
-nyx_error_t system_query_next_alarm(nyx_device_handle_t handle, time_t *time)
+nyx_error_t system_query_rtc_time(nyx_device_handle_t handle, time_t *time)
 {
 	if (handle != nyxDev)
 	{
@@ -165,7 +534,7 @@ nyx_error_t system_query_next_alarm(nyx_device_handle_t handle, time_t *time)
 		return NYX_ERROR_INVALID_OPERATION;
 	}
 
-	if (rtc_read_alarm_time(time) < 0)
+	if (rtc_time(time) < 0)
 	{
 		return NYX_ERROR_INVALID_OPERATION;
 	}
@@ -173,54 +542,553 @@ nyx_error_t system_query_next_alarm(nyx_device_handle_t handle, time_t *time)
 	return NYX_ERROR_NONE;
 }
 
-nyx_error_t system_query_rtc_time(nyx_device_handle_t handle, time_t *time)
+
+/**
+* @brief Report how far the cached RTC time was off the hardware RTC, in
+* seconds, at the last validation and at worst since the module opened.
+*/
+
+nyx_error_t system_query_rtc_drift(nyx_device_handle_t handle, time_t *last,
+                                   time_t *max)
 {
 	if (handle != nyxDev)
 	{
 		return NYX_ERROR_INVALID_HANDLE;
 	}
 
-	if (rtc_open() == 0)
+	rtc_cache_drift(last, max);
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+* @brief Report the RTC drift model: how far the RTC was ahead of the
+* wall clock at the last resume, in ns, and how fast that grows, in ns
+* per second. Wakeups are armed early by the error it predicts.
+*/
+
+nyx_error_t system_query_rtc_drift_rate(nyx_device_handle_t handle,
+                                        int64_t *offset_ns, int64_t *rate_ppb)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!rtc_drift_model(offset_ns, rate_ppb))
 	{
 		return NYX_ERROR_INVALID_OPERATION;
 	}
 
-	if (rtc_time(time) < 0)
+	return NYX_ERROR_NONE;
+}
+
+/**
+* @brief Number of device syscalls of one kind issued by the alarm path,
+* e.g. "RTC_WKALM_SET" or "timerfd_settime".
+*/
+
+nyx_error_t system_query_syscall_count(nyx_device_handle_t handle,
+                                       const char *op, uint64_t *count)
+{
+	int index;
+
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!op || !count || (index = syscall_stats_lookup(op)) < 0)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	*count = syscall_stats_get(index);
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+* @brief Latency histogram of the alarms delivered through a wakeup
+* backend, NULL for the backend in use.
+*/
+
+nyx_error_t system_query_backend_latency(nyx_device_handle_t handle,
+                                         const char *backend,
+                                         system_latency_histogram_t *hist)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!backend)
+	{
+		backend = wakeup_backend_name();
+	}
+
+	if (!hist || !backend)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	/* the histograms are updated by the dispatch thread */
+	dispatch_lock();
+
+	if (!latency_stats_backend(backend, hist))
+	{
+		memset(hist, 0, sizeof(*hist));
+	}
+
+	dispatch_unlock();
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+* @brief Latency histogram of the alarms delivered to one client.
+*/
+
+nyx_error_t system_query_client_latency(nyx_device_handle_t handle,
+                                        nyx_device_callback_function_t callback_func,
+                                        void *context,
+                                        system_latency_histogram_t *hist)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!hist)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	dispatch_lock();
+
+	if (!latency_stats_client(callback_func, context, hist))
+	{
+		memset(hist, 0, sizeof(*hist));
+	}
+
+	dispatch_unlock();
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+* @brief Clients ordered by the number of wakeups their alarms caused,
+* with how often their deadline was moved for exceeding the quota
+* (NYX_SYSTEM_ALARM_QUOTA_BURST).
+*
+* @param max size of clients
+* @param count number of entries filled in
+*/
+
+nyx_error_t system_query_wakeup_clients(nyx_device_handle_t handle,
+                                        system_client_wakeups_t *clients,
+                                        unsigned int max, unsigned int *count)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!clients || !count)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	dispatch_lock();
+	*count = alarm_quota_top(clients, max);
+	dispatch_unlock();
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+* @brief How long the module takes from noticing a wakeup to running the
+* alarm callbacks, and how many syscalls that takes per wakeup.
+*/
+
+nyx_error_t system_query_fire_path_latency(nyx_device_handle_t handle,
+                                           system_fire_path_stats_t *stats)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!stats)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	dispatch_lock();
+	latency_stats_fire(stats);
+	dispatch_unlock();
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+* @brief Totals over all suspend cycles and the most recent cycles,
+* newest first.
+*
+* @param cycles room for max cycles, may be NULL
+* @param count number of cycles filled in
+*/
+
+nyx_error_t system_query_suspend_stats(nyx_device_handle_t handle,
+                                       system_suspend_stats_t *stats,
+                                       system_suspend_cycle_t *cycles,
+                                       unsigned int max, unsigned int *count)
+{
+	guint n;
+
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!stats)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	n = power_stats_cycles(stats, cycles, max);
+
+	if (count)
+	{
+		*count = n;
+	}
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+* @brief Take a wake lock through libsuspend, accounted for in
+* system_query_wakelocks().
+*/
+
+nyx_error_t system_acquire_wake_lock(nyx_device_handle_t handle,
+                                     const char *name)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!name || !*name)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return power_stats_acquire_wake_lock(name) == 0 ? NYX_ERROR_NONE :
+	       NYX_ERROR_INVALID_OPERATION;
+}
+
+nyx_error_t system_release_wake_lock(nyx_device_handle_t handle,
+                                     const char *name)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!name || !*name)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	return power_stats_release_wake_lock(name) == 0 ? NYX_ERROR_NONE :
+	       NYX_ERROR_INVALID_OPERATION;
+}
+
+/**
+* @brief Wake locks taken with system_acquire_wake_lock(), the ones held
+* longest in total first.
+*/
+
+nyx_error_t system_query_wakelocks(nyx_device_handle_t handle,
+                                   system_wakelock_stats_t *locks,
+                                   unsigned int max, unsigned int *count)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!locks || !count)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	*count = power_stats_wakelocks(locks, max);
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+* @brief Replay an alarm trace on virtual clocks, see alarm_trace.c for
+* the format. Only available with the simulated wakeup backend
+* (NYX_SYSTEM_WAKEUP_BACKEND=sim).
+*/
+
+nyx_error_t system_replay_alarm_trace(nyx_device_handle_t handle,
+                                      const char *path,
+                                      system_sim_report_t *report)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!path || !report)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	if (!wakeup_sim_active())
 	{
 		return NYX_ERROR_INVALID_OPERATION;
 	}
 
+	return alarm_trace_replay(path, report) ? NYX_ERROR_NONE :
+	       NYX_ERROR_INVALID_OPERATION;
+}
+
+/**
+* @brief Write the module's statistics to the log.
+*/
+
+nyx_error_t system_dump_stats(nyx_device_handle_t handle)
+{
+	int64_t offset, rate;
+
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	dispatch_lock();
+	g_message("wakeup backend: %s", wakeup_backend_name() ? wakeup_backend_name() : "none");
+	syscall_stats_dump();
+	latency_stats_dump();
+	alarm_quota_dump();
+	power_stats_dump();
+
+	if (rtc_drift_model(&offset, &rate))
+	{
+		g_message("rtc drift: offset %" G_GINT64_FORMAT " ns, rate %" G_GINT64_FORMAT
+		          " ppb", (gint64)offset, (gint64)rate);
+	}
+
+	g_message("rtc writes: %u", rtc_sync_writes());
+	dispatch_unlock();
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+* @brief Set the callback that reports the end of every suspend cycle
+* started with system_suspend_async(): NYX_CALLBACK_STATUS_DONE if the
+* device suspended and resumed, NYX_CALLBACK_STATUS_FAILED if the cycle
+* was aborted. It runs on the suspend worker, without any of the
+* module's locks held. The cycle only ends once it returns, so starting
+* another one from the callback fails with NYX_ERROR_BUSY. NULL makes
+* system_suspend_async() wait for the cycle instead.
+*/
+
+nyx_error_t system_set_suspend_callback(nyx_device_handle_t handle,
+                                        nyx_device_callback_function_t callback_func,
+                                        void *context)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	dispatch_lock();
+	suspend_callback = callback_func;
+	suspend_context = context;
+	dispatch_unlock();
+
 	return NYX_ERROR_NONE;
 }
 
+/**
+* @brief Whether suspending now is worth it, i.e. the next wakeup alarm
+* is not due within the configured minimum residency. Going by the
+* queue rather than the RTC keeps this free of ioctls.
+*/
+
+static bool
+suspend_worthwhile(void)
+{
+	struct timespec next, now;
+	int64_t residency;
+
+	if (suspend_min_residency_ns <= 0 || !alarm_queue_next_wall(&next))
+	{
+		return true;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	residency = timespec_to_ns(&next) - timespec_to_ns(&now);
+
+	if (residency >= suspend_min_residency_ns)
+	{
+		return true;
+	}
+
+	g_debug("%s: next alarm due in %" G_GINT64_FORMAT "ms, not suspending",
+	        __FUNCTION__, residency / 1000000);
+	power_stats_avoided();
+
+	return false;
+}
+
+static void
+system_before_suspend(void)
+{
+	/* the RTC is what keeps time while suspended */
+	rtc_sync_flush(false);
+
+	/* an alarm may have been set, or time passed, since the cycle was
+	 * started */
+	if (!suspend_worthwhile())
+	{
+		suspend_avoid();
+	}
+}
+
+static void
+system_after_resume(void)
+{
+	rtc_cache_invalidate();
+	rtc_drift_sample();
+	rtc_sync_check();
+
+	/* deliver the non-wakeup alarms that expired while suspended; this
+	 * runs on the suspend worker, clients get them where they get every
+	 * other alarm */
+	alarm_queue_fire_async();
+}
+
+static void
+system_suspend_done(bool resumed, void *data)
+{
+	nyx_device_callback_function_t callback;
+	void *context;
+
+	dispatch_lock();
+	callback = suspend_callback;
+	context = suspend_context;
+	dispatch_unlock();
+
+	if (callback)
+	{
+		callback(nyxDev, resumed ? NYX_CALLBACK_STATUS_DONE :
+		         NYX_CALLBACK_STATUS_FAILED, context);
+	}
+}
+
+/**
+* @brief Suspend the device.
+*
+* The cycle runs on a worker thread. With a callback set through
+* system_set_suspend_callback() this returns as soon as it is started
+* and success tells whether it was; otherwise it waits for the cycle to
+* end and success tells whether the device suspended.
+*
+* No cycle is started if the next alarm is due within
+* NYX_SYSTEM_SUSPEND_MIN_RESIDENCY; success is then false.
+*/
 
 nyx_error_t system_suspend_async(nyx_device_handle_t handle, bool *success)
 {
+	bool async, resumed = false;
+
 	if (handle != nyxDev)
 		return NYX_ERROR_INVALID_HANDLE;
 
-	libsuspend_prepare_suspend();
-	libsuspend_enter_suspend();
+	if (!suspend_worthwhile())
+	{
+		if (success)
+			*success = false;
+
+		return NYX_ERROR_NONE;
+	}
+
+	dispatch_lock();
+	async = suspend_callback != NULL;
+	dispatch_unlock();
+
+	if (!suspend_start(async ? system_suspend_done : NULL, NULL, &resumed))
+	{
+		return NYX_ERROR_BUSY;
+	}
 
 	if (success)
-		*success = true;
+		*success = async || resumed;
 
 	return NYX_ERROR_NONE;
 }
 
+/**
+* @brief Abort a suspend cycle that has not entered suspend yet.
+*
+* Cycles resume on their own, so with none running there is nothing
+* left to do. success is false if the cycle is past the point where it
+* could be aborted.
+*/
+
 nyx_error_t system_resume(nyx_device_handle_t handle, bool *success)
 {
+	bool ret = true;
+
 	if (handle != nyxDev)
 		return NYX_ERROR_INVALID_HANDLE;
 
-	libsuspend_exit_suspend();
+	if (suspend_running())
+	{
+		ret = suspend_abort();
+	}
 
 	if (success)
-		*success = true;
+		*success = ret;
 
 	return NYX_ERROR_NONE;
 }
 
+/**
+* @brief The suspend cycle in progress or, if none is, the last one.
+*/
+
+nyx_error_t system_query_suspend_cycle(nyx_device_handle_t handle,
+                                       system_suspend_cycle_t *cycle)
+{
+	if (handle != nyxDev)
+	{
+		return NYX_ERROR_INVALID_HANDLE;
+	}
+
+	if (!cycle)
+	{
+		return NYX_ERROR_INVALID_VALUE;
+	}
+
+	suspend_last_cycle(cycle);
+
+	return NYX_ERROR_NONE;
+}
+
+/**
+* @brief Shut the device down. A normal shutdown first writes the wall
+* clock to the RTC if it is off, which waits for the next second to
+* start and so blocks the caller for up to a second.
+*/
 
 nyx_error_t system_shutdown(nyx_device_handle_t handle ,
                             nyx_system_shutdown_type_t type, const char *reason)
@@ -239,6 +1107,7 @@ nyx_error_t system_shutdown(nyx_device_handle_t handle ,
 		case NYX_SYSTEM_NORMAL_SHUTDOWN:
 		case NYX_SYSTEM_TEST_SHUTDOWN:
 		default:
+			rtc_sync_flush(true);
 			system("shutdown -h now");
 			break;
 	}
@@ -247,6 +1116,11 @@ nyx_error_t system_shutdown(nyx_device_handle_t handle ,
 }
 
 
+/**
+* @brief Reboot the device, blocking for up to a second like
+* system_shutdown() to bring the RTC up to date first.
+*/
+
 nyx_error_t system_reboot(nyx_device_handle_t handle ,
                           nyx_system_shutdown_type_t type, const char *reason)
 {
@@ -264,6 +1138,7 @@ nyx_error_t system_reboot(nyx_device_handle_t handle ,
 		case NYX_SYSTEM_NORMAL_SHUTDOWN:
 		case NYX_SYSTEM_TEST_SHUTDOWN:
 		default:
+			rtc_sync_flush(true);
 			system("reboot");
 			break;
 	}
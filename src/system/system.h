@@ -0,0 +1,230 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************
+* @file system.h
+*
+* @brief Module methods offered on top of the nyx System API. They are
+* exported by name like the registered methods so in-process clients
+* can resolve them from the loaded module.
+*******************************************
+*/
+
+#ifndef _SYSTEM_H_
+#define _SYSTEM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <nyx/nyx_module.h>
+
+/**
+ * Number of buckets in an alarm latency histogram. Bucket upper bounds
+ * are 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000 and 5000 ms; the last
+ * bucket holds everything later than that.
+ */
+#define SYSTEM_LATENCY_BUCKETS 12
+
+typedef struct
+{
+	uint64_t count;
+	uint64_t total_us;
+	uint64_t max_us;
+	uint64_t buckets[SYSTEM_LATENCY_BUCKETS];
+} system_latency_histogram_t;
+
+/**
+ * Time from noticing a wakeup event to delivering each alarm, through
+ * its callback or the batch callback, over the last 1024 alarms, and
+ * the syscalls made per wakeup event (syscalls / passes) from the event
+ * to re-arming.
+ */
+typedef struct
+{
+	uint64_t samples;
+	uint64_t p50_ns;
+	uint64_t p99_ns;
+	uint64_t max_ns;
+	uint64_t passes;
+	uint64_t syscalls;
+} system_fire_path_stats_t;
+
+typedef enum
+{
+	SYSTEM_SUSPEND_IDLE,
+	SYSTEM_SUSPEND_PREPARE,
+	SYSTEM_SUSPEND_ENTER,
+	SYSTEM_SUSPEND_RESUMED,
+	SYSTEM_SUSPEND_ABORTED,
+} system_suspend_state_t;
+
+/**
+ * One suspend cycle: the phase it is in or how it ended, and how long
+ * each phase took. enter_ns includes suspended_ns, the time actually
+ * spent suspended. With autosleep every resume of the kernel is a
+ * cycle, with prepare_ns 0 and enter_ns equal to suspended_ns.
+ */
+typedef struct
+{
+	system_suspend_state_t state;
+	uint64_t prepare_ns;
+	uint64_t enter_ns;
+	uint64_t suspended_ns;
+	uint64_t resume_ns;
+} system_suspend_cycle_t;
+
+/**
+ * Totals over all suspend cycles. avoided counts suspends not started or
+ * aborted while being prepared because the next alarm was too close to
+ * be worth it; those count neither as attempts nor as aborts.
+ */
+typedef struct
+{
+	uint64_t attempts;
+	uint64_t aborts;
+	uint64_t avoided;
+	uint64_t suspended_ns;
+	uint64_t max_resume_ns;
+} system_suspend_stats_t;
+
+#define SYSTEM_WAKELOCK_NAME_MAX 48
+
+/**
+ * How often a wake lock was taken and for how long it was held in total
+ * and at most, counting a current hold up to now.
+ */
+typedef struct
+{
+	char name[SYSTEM_WAKELOCK_NAME_MAX];
+	bool held;
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+} system_wakelock_stats_t;
+
+/**
+ * Outcome of replaying an alarm trace on the simulated wakeup backend.
+ * max_late_us covers every alarm delivered since the module was opened.
+ */
+typedef struct
+{
+	uint64_t requests;
+	uint64_t delivered;
+	uint64_t wakeups;
+	uint64_t programs;
+	uint64_t simulated_s;
+	uint64_t total_late_us;
+	uint64_t max_late_us;
+} system_sim_report_t;
+
+/**
+ * Wakeups charged to one client, i.e. caused by its alarm deadline, and
+ * how many of its alarms were deferred for exceeding the quota. Alarms
+ * without a callback are counted per id with the id as context. A NULL
+ * callback and context stand for the clients that did not fit into the
+ * table and share one quota, and hold the counts of clients that made
+ * room for others after being idle.
+ */
+typedef struct
+{
+	nyx_device_callback_function_t callback;
+	void *context;
+	uint64_t wakeups;
+	uint64_t deferred;
+} system_client_wakeups_t;
+
+/**
+ * Called with the ids of every alarm delivered by one wakeup.
+ */
+typedef void (*system_alarm_batch_cb_t)(nyx_device_handle_t handle,
+                                        const unsigned int *ids,
+                                        unsigned int count, void *context);
+
+nyx_error_t system_set_alarm_timespec(nyx_device_handle_t handle,
+                                      const struct timespec *time,
+                                      nyx_device_callback_function_t callback_func,
+                                      void *context);
+nyx_error_t system_set_alarm_range(nyx_device_handle_t handle, time_t earliest,
+                                   time_t latest,
+                                   nyx_device_callback_function_t callback_func,
+                                   void *context);
+nyx_error_t system_set_alarm_elapsed(nyx_device_handle_t handle,
+                                     const struct timespec *time,
+                                     nyx_device_callback_function_t callback_func,
+                                     void *context);
+nyx_error_t system_set_alarm_nonwakeup(nyx_device_handle_t handle,
+                                       const struct timespec *time,
+                                       nyx_device_callback_function_t callback_func,
+                                       void *context);
+nyx_error_t system_set_alarm_periodic(nyx_device_handle_t handle,
+                                      const struct timespec *first,
+                                      const struct timespec *interval,
+                                      bool phase_aligned,
+                                      nyx_device_callback_function_t callback_func,
+                                      void *context);
+nyx_error_t system_add_alarm(nyx_device_handle_t handle,
+                             const struct timespec *time, unsigned int *id);
+nyx_error_t system_remove_alarm(nyx_device_handle_t handle, unsigned int id);
+nyx_error_t system_set_alarm_batch_callback(nyx_device_handle_t handle,
+                                            system_alarm_batch_cb_t callback_func,
+                                            void *context);
+nyx_error_t system_query_next_alarm_verified(nyx_device_handle_t handle,
+                                             bool verify, time_t *time);
+nyx_error_t system_query_saved_wakeups(nyx_device_handle_t handle,
+                                       unsigned int *count);
+nyx_error_t system_query_rtc_drift(nyx_device_handle_t handle, time_t *last,
+                                   time_t *max);
+nyx_error_t system_query_rtc_drift_rate(nyx_device_handle_t handle,
+                                        int64_t *offset_ns, int64_t *rate_ppb);
+nyx_error_t system_query_syscall_count(nyx_device_handle_t handle,
+                                       const char *op, uint64_t *count);
+nyx_error_t system_query_backend_latency(nyx_device_handle_t handle,
+                                         const char *backend,
+                                         system_latency_histogram_t *hist);
+nyx_error_t system_query_client_latency(nyx_device_handle_t handle,
+                                        nyx_device_callback_function_t callback_func,
+                                        void *context,
+                                        system_latency_histogram_t *hist);
+nyx_error_t system_query_wakeup_clients(nyx_device_handle_t handle,
+                                        system_client_wakeups_t *clients,
+                                        unsigned int max, unsigned int *count);
+nyx_error_t system_query_fire_path_latency(nyx_device_handle_t handle,
+                                           system_fire_path_stats_t *stats);
+nyx_error_t system_set_suspend_callback(nyx_device_handle_t handle,
+                                        nyx_device_callback_function_t callback_func,
+                                        void *context);
+nyx_error_t system_query_suspend_cycle(nyx_device_handle_t handle,
+                                       system_suspend_cycle_t *cycle);
+nyx_error_t system_query_suspend_stats(nyx_device_handle_t handle,
+                                       system_suspend_stats_t *stats,
+                                       system_suspend_cycle_t *cycles,
+                                       unsigned int max, unsigned int *count);
+nyx_error_t system_acquire_wake_lock(nyx_device_handle_t handle,
+                                     const char *name);
+nyx_error_t system_release_wake_lock(nyx_device_handle_t handle,
+                                     const char *name);
+nyx_error_t system_query_wakelocks(nyx_device_handle_t handle,
+                                   system_wakelock_stats_t *locks,
+                                   unsigned int max, unsigned int *count);
+nyx_error_t system_replay_alarm_trace(nyx_device_handle_t handle,
+                                      const char *path,
+                                      system_sim_report_t *report);
+nyx_error_t system_dump_stats(nyx_device_handle_t handle);
+
+#endif
@@ -0,0 +1,86 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************
+* @file timespec.h
+*
+* @brief Helpers for struct timespec. A zero timespec means "not set".
+*******************************************
+*/
+
+#ifndef _TIMESPEC_H_
+#define _TIMESPEC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define NSEC_PER_SEC 1000000000LL
+
+static inline bool
+timespec_is_set(const struct timespec *ts)
+{
+	return ts->tv_sec != 0 || ts->tv_nsec != 0;
+}
+
+static inline int
+timespec_compare(const struct timespec *a, const struct timespec *b)
+{
+	if (a->tv_sec != b->tv_sec)
+	{
+		return a->tv_sec < b->tv_sec ? -1 : 1;
+	}
+
+	return (a->tv_nsec > b->tv_nsec) - (a->tv_nsec < b->tv_nsec);
+}
+
+static inline int64_t
+timespec_to_ns(const struct timespec *ts)
+{
+	return (int64_t)ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static inline struct timespec
+timespec_from_ns(int64_t ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ns / NSEC_PER_SEC;
+	ts.tv_nsec = ns % NSEC_PER_SEC;
+
+	if (ts.tv_nsec < 0)
+	{
+		ts.tv_sec--;
+		ts.tv_nsec += NSEC_PER_SEC;
+	}
+
+	return ts;
+}
+
+/**
+* @brief Whole seconds, rounded up so an alarm is never early.
+*/
+
+static inline time_t
+timespec_ceil_sec(const struct timespec *ts)
+{
+	return ts->tv_sec + (ts->tv_nsec > 0 ? 1 : 0);
+}
+
+#endif
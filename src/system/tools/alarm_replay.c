@@ -0,0 +1,156 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+****************************************************************
+* @file alarm_replay.c
+*
+* @brief Replays an alarm trace on the simulated wakeup backend outside
+* of any daemon, or writes a synthetic trace to replay.
+*
+*     nyx-alarm-replay <trace>
+*     nyx-alarm-replay -g <requests> <trace>
+*
+* The trace format is described in alarm_trace.c. Synthetic traces are
+* always the same for the same number of requests.
+***************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include "alarm_queue.h"
+#include "alarm_trace.h"
+#include "dispatch.h"
+
+#define SYNTHETIC_CLIENTS 64
+#define SYNTHETIC_SEED 12345
+
+static int
+generate(long requests, const char *path)
+{
+	GRand *rand = g_rand_new_with_seed(SYNTHETIC_SEED);
+	double t = 0;
+	FILE *f;
+	long i;
+
+	f = fopen(path, "w");
+
+	if (!f)
+	{
+		fprintf(stderr, "could not create %s\n", path);
+		g_rand_free(rand);
+		return 1;
+	}
+
+	fprintf(f, "# %ld synthetic requests from %d clients\n", requests,
+	        SYNTHETIC_CLIENTS);
+
+	for (i = 0; i < requests; i++)
+	{
+		guint client = g_rand_int_range(rand, 0, SYNTHETIC_CLIENTS);
+		double delay = g_rand_double_range(rand, 1, 3600);
+		gint32 kind = g_rand_int_range(rand, 0, 100);
+
+		t += g_rand_double_range(rand, 0, 60);
+
+		if (kind < 50)
+		{
+			fprintf(f, "%.3f set %u %.3f\n", t, client, delay);
+		}
+		else if (kind < 70)
+		{
+			fprintf(f, "%.3f range %u %.3f %.3f\n", t, client, delay,
+			        delay + g_rand_double_range(rand, 0, 600));
+		}
+		else if (kind < 80)
+		{
+			fprintf(f, "%.3f nonwakeup %u %.3f\n", t, client, delay);
+		}
+		else if (kind < 85)
+		{
+			fprintf(f, "%.3f periodic %u %.3f %.3f\n", t, client, delay,
+			        g_rand_double_range(rand, 300, 3600));
+		}
+		else
+		{
+			fprintf(f, "%.3f cancel %u\n", t, client);
+		}
+	}
+
+	fprintf(f, "%.3f end\n", t + 86400);
+	fclose(f);
+	g_rand_free(rand);
+
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	system_sim_report_t report;
+	gint64 start;
+	bool ok;
+
+	if (argc == 4 && !strcmp(argv[1], "-g"))
+	{
+		return generate(strtol(argv[2], NULL, 10), argv[3]);
+	}
+
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: %s <trace>\n       %s -g <requests> <trace>\n",
+		        argv[0], argv[0]);
+		return 2;
+	}
+
+	g_setenv("NYX_SYSTEM_WAKEUP_BACKEND", "sim", TRUE);
+	dispatch_init(false);
+
+	if (!alarm_queue_init(NULL))
+	{
+		fprintf(stderr, "could not open the simulated backend\n");
+		return 1;
+	}
+
+	start = g_get_monotonic_time();
+	ok = alarm_trace_replay(argv[1], &report);
+
+	if (ok)
+	{
+		printf("requests %" G_GUINT64_FORMAT "\n"
+		       "delivered %" G_GUINT64_FORMAT "\n"
+		       "wakeups %" G_GUINT64_FORMAT "\n"
+		       "programs %" G_GUINT64_FORMAT "\n"
+		       "simulated_s %" G_GUINT64_FORMAT "\n"
+		       "total_late_us %" G_GUINT64_FORMAT "\n"
+		       "max_late_us %" G_GUINT64_FORMAT "\n"
+		       "replay_us %" G_GINT64_FORMAT "\n",
+		       (guint64)report.requests, (guint64)report.delivered,
+		       (guint64)report.wakeups, (guint64)report.programs,
+		       (guint64)report.simulated_s, (guint64)report.total_late_us,
+		       (guint64)report.max_late_us,
+		       (gint64)(g_get_monotonic_time() - start));
+	}
+
+	alarm_queue_release();
+	dispatch_shutdown();
+
+	return ok ? 0 : 1;
+}
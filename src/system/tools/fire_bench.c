@@ -0,0 +1,307 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+****************************************************************
+* @file fire_bench.c
+*
+* @brief Measures the alarm fire path on the host: one alarm after the
+* other is set a millisecond ahead on the dispatch thread, alternating
+* alarms with a callback and alarms delivered by id through the batch
+* callback, and the fire path statistics are printed once all of them
+* were delivered.
+*
+*     nyx-fire-bench [-r] [alarms]
+*
+* The wakeup backend is timerfd unless NYX_SYSTEM_WAKEUP_BACKEND says
+* otherwise; on a host without alarm clocks it runs on the plain clocks.
+*
+* With -r it runs on the rtc backend instead, with a FIFO standing in
+* for /dev/rtc and the rtc ioctls answered here. Each alarm is set due
+* and the RTC_AF word is then written to the FIFO, so every wakeup goes
+* through rtc_event() and rtc_check_alarm(). The alarm that fired is
+* not cleared afterwards, the rtc core disables it itself; only a
+* pending alarm would be programmed again. The ioctls are counted as
+* syscalls even though they never reach a driver.
+***************************************************************
+*/
+
+#include <linux/rtc.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <glib.h>
+#include "alarm_queue.h"
+#include "dispatch.h"
+#include "latency_stats.h"
+#include "rtc.h"
+#include "timespec.h"
+#include "wakeup.h"
+
+#define BENCH_ALARMS 1000
+#define BENCH_LEAD_NS 1000000
+#define BENCH_TIMEOUT_US 1000000
+
+static guint delivered = 0;
+/* the alarm without a callback waited for, under the dispatch lock */
+static guint expected_id = 0;
+
+static void
+alarm_fired(nyx_device_handle_t handle, nyx_callback_status_t status,
+            void *context)
+{
+	__atomic_add_fetch(&delivered, 1, __ATOMIC_RELEASE);
+}
+
+static void
+batch_fired(nyx_device_handle_t handle, const guint *ids, guint count,
+            void *data)
+{
+	guint i;
+
+	/* alarms with a callback are reported here as well */
+	for (i = 0; i < count; i++)
+	{
+		if (ids[i] == expected_id)
+		{
+			__atomic_add_fetch(&delivered, 1, __ATOMIC_RELEASE);
+		}
+	}
+}
+
+/* the bench's end of the FIFO standing in for /dev/rtc, -1 if unused */
+static int rtc_feed = -1;
+static struct rtc_wkalrm rtc_alarm;
+
+/**
+* @brief The rtc ioctls on the FIFO opened as the RTC, anything else is
+* passed on to the kernel.
+*/
+
+int
+ioctl(int fd, unsigned long request, ...)
+{
+	struct rtc_time *rtc_tm;
+	struct timespec now;
+	struct tm tm;
+	va_list ap;
+	void *arg;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	if (rtc_feed < 0 || fd != rtc_getfd())
+	{
+		return syscall(SYS_ioctl, fd, request, arg);
+	}
+
+	switch (request)
+	{
+		case RTC_RD_TIME:
+			clock_gettime(CLOCK_REALTIME, &now);
+			gmtime_r(&now.tv_sec, &tm);
+			rtc_tm = arg;
+			rtc_tm->tm_sec = tm.tm_sec;
+			rtc_tm->tm_min = tm.tm_min;
+			rtc_tm->tm_hour = tm.tm_hour;
+			rtc_tm->tm_mday = tm.tm_mday;
+			rtc_tm->tm_mon = tm.tm_mon;
+			rtc_tm->tm_year = tm.tm_year;
+			rtc_tm->tm_wday = tm.tm_wday;
+			rtc_tm->tm_yday = tm.tm_yday;
+			rtc_tm->tm_isdst = tm.tm_isdst;
+			return 0;
+
+		case RTC_SET_TIME:
+			return 0;
+
+		case RTC_WKALM_SET:
+			rtc_alarm = *(struct rtc_wkalrm *)arg;
+			return 0;
+
+		case RTC_WKALM_RD:
+			*(struct rtc_wkalrm *)arg = rtc_alarm;
+			return 0;
+
+		default:
+			errno = ENOTTY;
+			return -1;
+	}
+}
+
+/**
+* @brief Set up the FIFO standing in for /dev/rtc and select the rtc
+* backend.
+*/
+
+static bool
+rtc_fake_open(void)
+{
+	gchar *dir = g_mkdtemp(g_strdup("/tmp/nyx-fire-bench-XXXXXX"));
+	gchar *path;
+
+	if (!dir)
+	{
+		return false;
+	}
+
+	path = g_build_filename(dir, "rtc", NULL);
+
+	/* opened read-write here first, so the module's read-only open
+	 * finds a writer and does not block */
+	if (mkfifo(path, 0600) < 0 ||
+	    (rtc_feed = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC)) < 0)
+	{
+		g_free(path);
+		g_free(dir);
+		return false;
+	}
+
+	rtc_set_device(path);
+	g_setenv("NYX_SYSTEM_WAKEUP_BACKEND", "rtc", TRUE);
+	g_free(dir);
+
+	/* path stays in use as the device name */
+	return true;
+}
+
+/**
+* @brief Have the fake RTC report its alarm, as the driver does when the
+* alarm interrupt comes in.
+*/
+
+static void
+rtc_fake_fire(void)
+{
+	unsigned long data = RTC_AF | RTC_IRQF | (1 << 8);
+
+	if (write(rtc_feed, &data, sizeof(data)) != sizeof(data))
+	{
+		fprintf(stderr, "could not feed the RTC %d\n", errno);
+	}
+}
+
+static bool
+wait_delivered(guint count)
+{
+	guint waited;
+
+	for (waited = 0; waited < BENCH_TIMEOUT_US; waited += 100)
+	{
+		if (__atomic_load_n(&delivered, __ATOMIC_ACQUIRE) >= count)
+		{
+			return true;
+		}
+
+		usleep(100);
+	}
+
+	return false;
+}
+
+int
+main(int argc, char **argv)
+{
+	system_fire_path_stats_t stats;
+	bool rtc = argc > 1 && !strcmp(argv[1], "-r");
+	long alarms = argc > 1 + rtc ? strtol(argv[1 + rtc], NULL, 10) : BENCH_ALARMS;
+	long i;
+
+	if (alarms <= 0)
+	{
+		fprintf(stderr, "usage: %s [-r] [alarms]\n", argv[0]);
+		return 2;
+	}
+
+	if (rtc && !rtc_fake_open())
+	{
+		fprintf(stderr, "could not set up the fake RTC\n");
+		return 1;
+	}
+
+	g_setenv("NYX_SYSTEM_WAKEUP_BACKEND", "timerfd", FALSE);
+
+	if (!dispatch_init(true) || !alarm_queue_init(NULL))
+	{
+		fprintf(stderr, "could not open the wakeup backend\n");
+		return 1;
+	}
+
+	alarm_queue_set_batch_func(batch_fired, NULL);
+
+	for (i = 0; i < alarms; i++)
+	{
+		struct timespec now, expiry;
+
+		clock_gettime(CLOCK_REALTIME, &now);
+		/* the RTC only fires when told to, so its alarms are due already */
+		expiry = rtc ? now : timespec_from_ns(timespec_to_ns(&now) + BENCH_LEAD_NS);
+
+		if (i % 2)
+		{
+			/* it cannot fire before its id is known */
+			dispatch_lock();
+			expected_id = alarm_queue_add(ALARM_CLOCK_REALTIME, &expiry, NULL, NULL);
+			dispatch_unlock();
+		}
+		else
+		{
+			alarm_queue_set(ALARM_CLOCK_REALTIME, &expiry, alarm_fired, NULL);
+		}
+
+		if (rtc)
+		{
+			rtc_fake_fire();
+		}
+
+		if (!wait_delivered(i + 1))
+		{
+			fprintf(stderr, "alarm %ld was not delivered\n", i);
+			break;
+		}
+	}
+
+	dispatch_lock();
+	latency_stats_fire(&stats);
+	dispatch_unlock();
+
+	printf("backend %s\n"
+	       "alarms %ld\n"
+	       "samples %" G_GUINT64_FORMAT "\n"
+	       "p50_us %.1f\n"
+	       "p99_us %.1f\n"
+	       "max_us %.1f\n"
+	       "syscalls_per_wakeup %.2f\n",
+	       wakeup_backend_name(), i, (guint64)stats.samples, stats.p50_ns / 1000.0, stats.p99_ns / 1000.0,
+	       stats.max_ns / 1000.0,
+	       stats.passes ? (double)stats.syscalls / stats.passes : 0.0);
+
+	alarm_queue_release();
+	dispatch_shutdown();
+
+	return i == alarms ? 0 : 1;
+}
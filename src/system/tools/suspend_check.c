@@ -0,0 +1,191 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+****************************************************************
+* @file suspend_check.c
+*
+* @brief Runs the wakeup_count and autosleep suspend modes against a
+* directory of plain files standing in for /sys/power, and checks that
+* both ways a wakeup_count cycle aborts do abort without writing
+* /sys/power/state:
+*
+*  - no count can be read when the cycle is prepared, here because
+*    wakeup_count is missing or a symlink to /dev/full, which reads as
+*    NULs
+*  - the kernel refuses the count written back right before suspending,
+*    here because wakeup_count is a symlink to a proc file that holds a
+*    number but cannot be written, not even by root
+*
+*     nyx-suspend-check [directory]
+*
+* The directory, a new one under /tmp by default, is left behind.
+***************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include "power_stats.h"
+#include "suspend.h"
+
+/* reads as a number, refuses writes like a stale wakeup_count */
+#define REFUSING_COUNT "/proc/sys/kernel/ngroups_max"
+
+static const char *root;
+static int failed = 0;
+
+static void
+attr_write(const char *attr, const char *value)
+{
+	gchar *path = g_build_filename(root, attr, NULL);
+
+	g_file_set_contents(path, value, -1, NULL);
+	g_free(path);
+}
+
+static bool
+attr_is(const char *attr, const char *value)
+{
+	gchar *path = g_build_filename(root, attr, NULL);
+	gchar *contents = NULL;
+	bool ret;
+
+	ret = g_file_get_contents(path, &contents, NULL, NULL) &&
+	      !strcmp(g_strchomp(contents), value);
+	g_free(contents);
+	g_free(path);
+
+	return ret;
+}
+
+static void
+check(const char *what, bool ok)
+{
+	printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+
+	if (!ok)
+	{
+		failed++;
+	}
+}
+
+static bool
+cycle_ended(system_suspend_state_t state)
+{
+	system_suspend_cycle_t cycle;
+
+	suspend_last_cycle(&cycle);
+
+	return cycle.state == state;
+}
+
+/**
+* @brief Whether the last cycle got past prepare, only then does it
+* spend time in ENTER.
+*/
+
+static bool
+cycle_entered(void)
+{
+	system_suspend_cycle_t cycle;
+
+	suspend_last_cycle(&cycle);
+
+	return cycle.enter_ns > 0;
+}
+
+/**
+* @brief Run a wakeup_count cycle with wakeup_count a symlink to target,
+* which must abort without writing state.
+*/
+
+static void
+check_abort(const char *what, const char *target, bool entered)
+{
+	gchar *link = g_build_filename(root, "wakeup_count", NULL);
+	gchar *label = g_strdup_printf("%s aborts %s", what,
+	                               entered ? "on the write-back" : "while preparing");
+	bool resumed;
+
+	unlink(link);
+	attr_write("state", "");
+
+	if (target && symlink(target, link) < 0)
+	{
+		check(label, false);
+	}
+	else
+	{
+		suspend_start(NULL, NULL, &resumed);
+		check(label, !resumed && cycle_ended(SYSTEM_SUSPEND_ABORTED) &&
+		      cycle_entered() == entered && attr_is("state", ""));
+	}
+
+	unlink(link);
+	g_free(label);
+	g_free(link);
+}
+
+int
+main(int argc, char **argv)
+{
+	system_suspend_stats_t stats;
+	bool resumed;
+
+	root = argc > 1 ? argv[1] : g_mkdtemp(g_strdup("/tmp/nyx-suspend-XXXXXX"));
+
+	if (!root)
+	{
+		fprintf(stderr, "could not create a directory for /sys/power\n");
+		return 1;
+	}
+
+	suspend_sysfs_set_root(root);
+	suspend_set_mode("wakeup_count");
+
+	attr_write("wakeup_count", "42\n");
+	attr_write("state", "");
+	attr_write("autosleep", "off\n");
+
+	suspend_start(NULL, NULL, &resumed);
+	check("wakeup_count suspends", resumed && cycle_ended(SYSTEM_SUSPEND_RESUMED) &&
+	      attr_is("wakeup_count", "42") && attr_is("state", "mem"));
+
+	check_abort("wakeup_count refused by the kernel", REFUSING_COUNT, true);
+	check_abort("wakeup_count holding no count", "/dev/full", false);
+	check_abort("wakeup_count missing", NULL, false);
+
+	suspend_set_mode("autosleep");
+	suspend_start(NULL, NULL, &resumed);
+	check("autosleep is handed over", resumed && suspend_running() &&
+	      attr_is("autosleep", "mem"));
+
+	suspend_abort();
+	suspend_release();
+	check("autosleep is turned off", !suspend_running() &&
+	      cycle_ended(SYSTEM_SUSPEND_RESUMED) && attr_is("autosleep", "off"));
+
+	/* the autosleep cycle itself is not one, the kernel did not resume */
+	power_stats_cycles(&stats, NULL, 0);
+	check("cycles recorded", stats.attempts == 4 && stats.aborts == 3);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,620 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+****************************************************************
+* @file wakeup.c
+*
+* @brief Picks the wakeup backend when the module is opened and programs
+* only that one.
+*
+* Backends are probed in order of preference: timerfd on the *_ALARM
+* clocks, the Android alarm driver, the sysfs wakealarm attribute and
+* finally the legacy rtc ioctls. NYX_SYSTEM_WAKEUP_BACKEND forces one
+* of them by name. The simulated backend is only used when forced.
+*
+* A timer cancelled on every change of the wall clock tells us when the
+* clock is set, so wakeups that depend on the wall clock's relation to
+* other clocks can be programmed again.
+***************************************************************
+*/
+
+#include <string.h>
+#include <time.h>
+#include <stdbool.h>
+#include <glib.h>
+#include "config.h"
+#include "rtc.h"
+#include "rtc_sync.h"
+#include "alarm_timer.h"
+#include "suspend.h"
+#include "wakeup.h"
+#include "timespec.h"
+
+/**
+ * @addtogroup RTCAlarms
+ * @{
+ */
+
+static const struct wakeup_backend *backends[WAKEUP_BACKEND_COUNT] =
+{
+	&wakeup_timerfd_backend,
+	&wakeup_android_backend,
+	&wakeup_sysfs_backend,
+	&wakeup_rtc_backend,
+	&wakeup_sim_backend,
+};
+
+static const struct wakeup_backend *backend = NULL;
+static WakeupFunc wakeup_func = NULL;
+
+/* what is currently armed, 0 if nothing */
+static struct timespec wake_armed[ALARM_CLOCK_COUNT];
+static struct timespec notify_armed[ALARM_CLOCK_COUNT];
+/* what was last asked for through wakeup_program() */
+static struct timespec requested[ALARM_CLOCK_COUNT];
+
+static struct alarm_timer clock_watch = ALARM_TIMER_INIT;
+
+/* expiry the drift lead was last computed for and the wake it gave */
+static struct timespec lead_for[ALARM_CLOCK_COUNT];
+static struct timespec lead_wake[ALARM_CLOCK_COUNT];
+/* time spent suspended so far when the lead was computed */
+static int64_t lead_asleep[ALARM_CLOCK_COUNT];
+
+/* suspended time that has to pass for the clocks to have been stepped
+ * from the RTC */
+#define WAKEUP_MIN_SLEEP_NS 1000000
+
+static struct alarm_timer notify_timers[ALARM_CLOCK_COUNT] =
+{
+	ALARM_TIMER_INIT,
+	ALARM_TIMER_INIT,
+};
+
+static const clockid_t notify_clockids[ALARM_CLOCK_COUNT] =
+{
+	CLOCK_REALTIME,
+	CLOCK_BOOTTIME,
+};
+
+/* plain timers for non-wakeup alarms, they do not run during suspend */
+static struct alarm_timer lazy_timers[ALARM_CLOCK_COUNT] =
+{
+	ALARM_TIMER_INIT,
+	ALARM_TIMER_INIT,
+};
+static struct timespec lazy_armed[ALARM_CLOCK_COUNT];
+
+void
+wakeup_clock_now(AlarmClock clock, struct timespec *now)
+{
+	if (backend && backend->now)
+	{
+		backend->now(clock, now);
+	}
+	else
+	{
+		clock_gettime(notify_clockids[clock], now);
+	}
+}
+
+/**
+* @brief Convert an absolute time on the given clock to wall time, as
+* seen from now.
+*/
+
+void
+wakeup_to_wall(AlarmClock clock, const struct timespec *expiry,
+               struct timespec *wall)
+{
+	struct timespec now, wall_now;
+
+	if (clock == ALARM_CLOCK_REALTIME)
+	{
+		*wall = *expiry;
+		return;
+	}
+
+	wakeup_clock_now(clock, &now);
+	wakeup_clock_now(ALARM_CLOCK_REALTIME, &wall_now);
+	*wall = timespec_from_ns(timespec_to_ns(&wall_now) + timespec_to_ns(expiry) -
+	                         timespec_to_ns(&now));
+}
+
+static inline bool
+backend_native(AlarmClock clock)
+{
+	return backend->clocks & ALARM_CLOCK_MASK(clock);
+}
+
+static inline bool
+needs_notifier(AlarmClock clock)
+{
+	return !backend->notifies || !backend_native(clock);
+}
+
+/**
+* @brief Forget about every armed wakeup that has expired by now; the
+* hardware has no alarm pending for it anymore.
+*/
+
+static void
+wakeup_expired(AlarmClock clock)
+{
+	guint c;
+
+	for (c = 0; c < ALARM_CLOCK_COUNT; c++)
+	{
+		struct timespec now;
+
+		wakeup_clock_now(c, &now);
+
+		if (timespec_is_set(&wake_armed[c]) &&
+		    timespec_compare(&wake_armed[c], &now) <= 0)
+		{
+			memset(&wake_armed[c], 0, sizeof(wake_armed[c]));
+		}
+
+		if (timespec_is_set(&notify_armed[c]) &&
+		    timespec_compare(&notify_armed[c], &now) <= 0)
+		{
+			memset(&notify_armed[c], 0, sizeof(notify_armed[c]));
+		}
+	}
+
+	wakeup_func(clock);
+}
+
+static void
+notify_timer_fired(struct alarm_timer *timer)
+{
+	wakeup_expired(timer == &notify_timers[ALARM_CLOCK_BOOTTIME] ?
+	               ALARM_CLOCK_BOOTTIME : ALARM_CLOCK_REALTIME);
+}
+
+static void
+lazy_timer_fired(struct alarm_timer *timer)
+{
+	AlarmClock clock = timer == &lazy_timers[ALARM_CLOCK_BOOTTIME] ?
+	                   ALARM_CLOCK_BOOTTIME : ALARM_CLOCK_REALTIME;
+
+	memset(&lazy_armed[clock], 0, sizeof(lazy_armed[clock]));
+	wakeup_expired(clock);
+}
+
+/**
+* @brief The wall clock was set.
+*
+* Wall clock alarms armed on timerfd or the Android driver keep their
+* wall time, the kernel takes care of them. What needs another look is
+* what we derived from the wall clock ourselves: the rtc cache, boot
+* clock alarms converted to wall time, and backends that hand the wall
+* time to the RTC hardware. Only those wakeups whose value changes are
+* reprogrammed. The kernel reports resuming the same way, which is
+* passed on to the suspend worker for autosleep.
+*/
+
+static void
+wakeup_clock_set(struct alarm_timer *timer)
+{
+	g_message("Wall clock was set, re-arming dependent wakeups");
+
+	rtc_cache_invalidate();
+	rtc_drift_reanchor();
+	rtc_sync_clock_set();
+	suspend_clock_set();
+
+	if (!backend->follows_clock_set)
+	{
+		memset(&wake_armed[ALARM_CLOCK_REALTIME], 0,
+		       sizeof(wake_armed[ALARM_CLOCK_REALTIME]));
+	}
+
+	wakeup_program(requested);
+}
+
+/**
+* @brief Program every wakeup again, e.g. because it was found to have
+* been changed behind our back.
+*/
+
+void
+wakeup_resync(void)
+{
+	if (!backend)
+	{
+		return;
+	}
+
+	memset(wake_armed, 0, sizeof(wake_armed));
+	memset(notify_armed, 0, sizeof(notify_armed));
+	wakeup_program(requested);
+}
+
+static bool
+try_backend(const struct wakeup_backend *candidate, bool forced)
+{
+	guint c;
+
+	if (!candidate->open(wakeup_expired, forced))
+	{
+		return false;
+	}
+
+	backend = candidate;
+
+	for (c = 0; c < ALARM_CLOCK_COUNT; c++)
+	{
+		if (needs_notifier(c) &&
+		    !alarm_timer_open(&notify_timers[c], notify_clockids[c], notify_timer_fired))
+		{
+			g_critical("%s: could not create notification timer", __FUNCTION__);
+			wakeup_close();
+			return false;
+		}
+	}
+
+	if (!alarm_timer_watch_clock_set(&clock_watch, wakeup_clock_set))
+	{
+		g_warning("%s: wall clock changes will not be noticed", __FUNCTION__);
+	}
+
+	return true;
+}
+
+/**
+* @brief Select and open the wakeup backend.
+*
+* @param func called whenever an armed wakeup may have expired
+*/
+
+bool
+wakeup_open(WakeupFunc func)
+{
+	const char *name = config_get_string("WAKEUP_BACKEND", NULL);
+	guint i;
+
+	if (backend)
+	{
+		return true;
+	}
+
+	wakeup_func = func;
+
+	for (i = 0; i < G_N_ELEMENTS(backends); i++)
+	{
+		if (name && strcmp(name, backends[i]->name) != 0)
+		{
+			continue;
+		}
+
+		if (try_backend(backends[i], name != NULL))
+		{
+			g_message("Using %s wakeup backend", backend->name);
+			return true;
+		}
+	}
+
+	g_critical("No usable wakeup backend%s%s", name ? " named " : "",
+	           name ? name : "");
+
+	return false;
+}
+
+void
+wakeup_close(void)
+{
+	guint c;
+
+	alarm_timer_close(&clock_watch);
+
+	for (c = 0; c < ALARM_CLOCK_COUNT; c++)
+	{
+		alarm_timer_close(&notify_timers[c]);
+		alarm_timer_close(&lazy_timers[c]);
+		memset(&wake_armed[c], 0, sizeof(wake_armed[c]));
+		memset(&lazy_armed[c], 0, sizeof(lazy_armed[c]));
+		memset(&notify_armed[c], 0, sizeof(notify_armed[c]));
+		memset(&requested[c], 0, sizeof(requested[c]));
+		memset(&lead_for[c], 0, sizeof(lead_for[c]));
+	}
+
+	if (backend)
+	{
+		backend->close();
+		backend = NULL;
+	}
+}
+
+bool
+wakeup_programs_rtc(void)
+{
+	return backend && backend->programs_rtc;
+}
+
+const char *
+wakeup_backend_name(void)
+{
+	return backend ? backend->name : NULL;
+}
+
+static bool
+program_wake(AlarmClock clock, const struct timespec *expiry)
+{
+	if (timespec_compare(expiry, &wake_armed[clock]) == 0)
+	{
+		return true;
+	}
+
+	if (!timespec_is_set(expiry))
+	{
+		backend->clear(clock);
+	}
+	else if (!backend->set(clock, expiry))
+	{
+		return false;
+	}
+
+	wake_armed[clock] = *expiry;
+
+	return true;
+}
+
+static bool
+program_notify(AlarmClock clock, const struct timespec *expiry)
+{
+	if (timespec_compare(expiry, &notify_armed[clock]) == 0)
+	{
+		return true;
+	}
+
+	if (!timespec_is_set(expiry))
+	{
+		alarm_timer_clear(&notify_timers[clock]);
+	}
+	else if (!alarm_timer_set(&notify_timers[clock], expiry))
+	{
+		return false;
+	}
+
+	notify_armed[clock] = *expiry;
+
+	return true;
+}
+
+/**
+* @brief Time spent suspended since boot: CLOCK_MONOTONIC stops while
+* suspended, CLOCK_BOOTTIME does not.
+*/
+
+static int64_t
+asleep_ns(void)
+{
+	struct timespec mono, boot;
+
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	clock_gettime(CLOCK_BOOTTIME, &boot);
+
+	return timespec_to_ns(&boot) - timespec_to_ns(&mono);
+}
+
+/**
+* @brief Move a wakeup earlier by the error the RTC drift model predicts
+* for it, so a device sleeping on a slow RTC does not wake up late.
+*
+* The lead is computed once per expiry so re-arming the same expiry
+* does not reprogram the hardware. The early wakeup is when the clocks,
+* stepped forward by the slow RTC on resume, say it is still ahead of
+* the expiry, so wakeup_drift_slack() has the alarms delivered then.
+* If the device stayed awake the clocks were not stepped, nothing is
+* delivered early and the wakeup is re-armed at the expiry itself.
+*
+* Backends that program the RTC themselves already convert to RTC time
+* with the measured offset and are not compensated again.
+*/
+
+static void
+drift_compensate(AlarmClock clock, struct timespec *wake)
+{
+	struct timespec now;
+	int64_t lead;
+
+	if (!timespec_is_set(wake) || backend->programs_rtc)
+	{
+		memset(&lead_for[clock], 0, sizeof(lead_for[clock]));
+		memset(&lead_wake[clock], 0, sizeof(lead_wake[clock]));
+		return;
+	}
+
+	wakeup_clock_now(clock, &now);
+
+	if (timespec_compare(wake, &lead_for[clock]) != 0)
+	{
+		lead_for[clock] = *wake;
+		lead_wake[clock] = *wake;
+		lead_asleep[clock] = asleep_ns();
+		lead = rtc_drift_lead_ns(timespec_to_ns(wake) - timespec_to_ns(&now));
+
+		if (lead > 0)
+		{
+			lead_wake[clock] = timespec_from_ns(timespec_to_ns(wake) - lead);
+		}
+	}
+
+	if (timespec_compare(&lead_wake[clock], &now) > 0)
+	{
+		*wake = lead_wake[clock];
+	}
+}
+
+/**
+* @brief How much earlier than their time alarms of clock are due now,
+* i.e. the drift lead if the early wakeup for it has been reached after
+* a resume.
+*/
+
+int64_t
+wakeup_drift_slack(AlarmClock clock)
+{
+	struct timespec now;
+
+	if (!backend)
+	{
+		return 0;
+	}
+
+	/* clocks armed through the wall clock share its lead */
+	if (!backend_native(clock))
+	{
+		clock = ALARM_CLOCK_REALTIME;
+	}
+
+	if (!timespec_is_set(&lead_for[clock]))
+	{
+		return 0;
+	}
+
+	wakeup_clock_now(clock, &now);
+
+	if (timespec_compare(&now, &lead_wake[clock]) < 0 ||
+	    timespec_compare(&now, &lead_for[clock]) >= 0)
+	{
+		return 0;
+	}
+
+	/* awake all along, the RTC never stepped the clock */
+	if (asleep_ns() - lead_asleep[clock] < WAKEUP_MIN_SLEEP_NS)
+	{
+		return 0;
+	}
+
+	return timespec_to_ns(&lead_for[clock]) - timespec_to_ns(&lead_wake[clock]);
+}
+
+/**
+* @brief Arm the wakeups for the next alarm of each clock, a zero
+* timespec meaning none.
+*
+* Clocks the backend cannot arm natively are converted to wall time and
+* merged into the wall clock wakeup.
+*/
+
+bool
+wakeup_program(const struct timespec expiry[ALARM_CLOCK_COUNT])
+{
+	struct timespec wake[ALARM_CLOCK_COUNT];
+	struct timespec *wall = &wake[ALARM_CLOCK_REALTIME];
+	bool ret = true;
+	guint c;
+
+	if (!backend)
+	{
+		return false;
+	}
+
+	if (expiry != requested)
+	{
+		memcpy(requested, expiry, sizeof(requested));
+	}
+
+	memcpy(wake, expiry, sizeof(wake));
+
+	for (c = 0; c < ALARM_CLOCK_COUNT; c++)
+	{
+		struct timespec converted;
+
+		if (!timespec_is_set(&expiry[c]) || backend_native(c))
+		{
+			continue;
+		}
+
+		wakeup_to_wall(c, &expiry[c], &converted);
+
+		if (!timespec_is_set(wall) || timespec_compare(&converted, wall) < 0)
+		{
+			*wall = converted;
+		}
+
+		memset(&wake[c], 0, sizeof(wake[c]));
+	}
+
+	for (c = 0; c < ALARM_CLOCK_COUNT; c++)
+	{
+		if (backend_native(c))
+		{
+			drift_compensate(c, &wake[c]);
+			ret = program_wake(c, &wake[c]) && ret;
+		}
+
+		if (needs_notifier(c))
+		{
+			ret = program_notify(c, &expiry[c]) && ret;
+		}
+	}
+
+	return ret;
+}
+
+/**
+* @brief Arm the timers for the next non-wakeup alarm of each clock, a
+* zero timespec meaning none.
+*
+* These are plain timers: they fire while the device is awake and are
+* otherwise caught up with on resume, never waking the device. Backends
+* running on clocks of their own only deliver them with their wakeups.
+*/
+
+bool
+wakeup_program_lazy(const struct timespec expiry[ALARM_CLOCK_COUNT])
+{
+	bool ret = true;
+	guint c;
+
+	if (!backend || backend->now)
+	{
+		return backend != NULL;
+	}
+
+	for (c = 0; c < ALARM_CLOCK_COUNT; c++)
+	{
+		if (timespec_compare(&expiry[c], &lazy_armed[c]) == 0)
+		{
+			continue;
+		}
+
+		if (!timespec_is_set(&expiry[c]))
+		{
+			alarm_timer_clear(&lazy_timers[c]);
+		}
+		else if ((lazy_timers[c].fd < 0 &&
+		          !alarm_timer_open(&lazy_timers[c], notify_clockids[c],
+		                            lazy_timer_fired)) ||
+		         !alarm_timer_set(&lazy_timers[c], &expiry[c]))
+		{
+			ret = false;
+			continue;
+		}
+
+		lazy_armed[c] = expiry[c];
+	}
+
+	return ret;
+}
+
+/* @} END OF RTCAlarms */
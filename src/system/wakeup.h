@@ -0,0 +1,95 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+*******************************************
+* @file wakeup.h
+*
+* @brief Interface between the alarm queue and the kernel facility that
+* wakes the device when an alarm is due.
+*******************************************
+*/
+
+#ifndef _WAKEUP_H_
+#define _WAKEUP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef enum
+{
+	ALARM_CLOCK_REALTIME,
+	ALARM_CLOCK_BOOTTIME,
+	ALARM_CLOCK_COUNT
+} AlarmClock;
+
+#define ALARM_CLOCK_MASK(clock) (1U << (clock))
+
+typedef void (*WakeupFunc)(AlarmClock clock);
+
+/**
+ * A wakeup backend arms one wakeup per clock it handles natively (see
+ * @clocks). Alarms on any other clock are converted to wall time by the
+ * caller. Backends that cannot tell us when their alarm expired leave
+ * @notifies unset and get a plain timerfd per clock alongside.
+ * @follows_clock_set is set when the kernel keeps a wall clock wakeup
+ * at the same wall time if the clock is set; the others are programmed
+ * again after a clock change. @programs_rtc marks backends whose wakeup
+ * is the RTC alarm itself, so it can be read back with RTC_WKALM_RD.
+ * A backend may provide @now to run the
+ * module on clocks of its own.
+ */
+struct wakeup_backend
+{
+	const char *name;
+	unsigned int clocks;
+	bool notifies;
+	bool follows_clock_set;
+	bool programs_rtc;
+	bool (*open)(WakeupFunc func, bool forced);
+	void (*close)(void);
+	bool (*set)(AlarmClock clock, const struct timespec *expiry);
+	bool (*clear)(AlarmClock clock);
+	void (*now)(AlarmClock clock, struct timespec *now);
+};
+
+extern const struct wakeup_backend wakeup_timerfd_backend;
+extern const struct wakeup_backend wakeup_android_backend;
+extern const struct wakeup_backend wakeup_sysfs_backend;
+extern const struct wakeup_backend wakeup_rtc_backend;
+extern const struct wakeup_backend wakeup_sim_backend;
+
+#define WAKEUP_BACKEND_COUNT 5
+
+bool wakeup_open(WakeupFunc func);
+void wakeup_close(void);
+const char *wakeup_backend_name(void);
+bool wakeup_program(const struct timespec expiry[ALARM_CLOCK_COUNT]);
+bool wakeup_program_lazy(const struct timespec expiry[ALARM_CLOCK_COUNT]);
+void wakeup_clock_now(AlarmClock clock, struct timespec *now);
+void wakeup_to_wall(AlarmClock clock, const struct timespec *expiry,
+                    struct timespec *wall);
+bool wakeup_programs_rtc(void);
+int64_t wakeup_drift_slack(AlarmClock clock);
+void wakeup_resync(void);
+bool wakeup_sim_active(void);
+void wakeup_sim_advance(int64_t ns);
+void wakeup_sim_counts(uint64_t *wakeups, uint64_t *programs);
+
+#endif
@@ -0,0 +1,90 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2014 Simon Busch <morphis@gravedo.de>
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+****************************************************************
+* @file wakeup_android.c
+*
+* @brief Wakeup backend on the Android alarm driver (/dev/alarm).
+*
+* Wall clock alarms use ANDROID_ALARM_RTC_WAKEUP and boot clock alarms
+* ANDROID_ALARM_ELAPSED_REALTIME_WAKEUP. The driver programs the rtc
+* itself. Waiting for expiry would need a blocking ANDROID_ALARM_WAIT,
+* so expiry is signalled by a plain timerfd set up by the caller.
+***************************************************************
+*/
+
+#include <time.h>
+#include <stdbool.h>
+#include "alarm.h"
+#include "wakeup.h"
+
+/**
+ * @addtogroup RTCAlarms
+ * @{
+ */
+
+static bool
+android_open(WakeupFunc func, bool forced)
+{
+	return android_alarm_open();
+}
+
+static void
+android_close(void)
+{
+	android_alarm_close();
+}
+
+static bool
+android_set(AlarmClock clock, const struct timespec *expiry)
+{
+	if (clock == ALARM_CLOCK_BOOTTIME)
+	{
+		return android_alarm_set_elapsed(expiry);
+	}
+
+	return android_alarm_set(expiry);
+}
+
+static bool
+android_clear(AlarmClock clock)
+{
+	if (clock == ALARM_CLOCK_BOOTTIME)
+	{
+		return android_alarm_clear_elapsed();
+	}
+
+	return android_alarm_clear();
+}
+
+const struct wakeup_backend wakeup_android_backend =
+{
+	.name = "android",
+	.clocks = ALARM_CLOCK_MASK(ALARM_CLOCK_REALTIME) |
+	          ALARM_CLOCK_MASK(ALARM_CLOCK_BOOTTIME),
+	.notifies = false,
+	.follows_clock_set = true,
+	.programs_rtc = false,
+	.open = android_open,
+	.close = android_close,
+	.set = android_set,
+	.clear = android_clear,
+};
+
+/* @} END OF RTCAlarms */
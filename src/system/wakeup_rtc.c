@@ -0,0 +1,95 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+****************************************************************
+* @file wakeup_rtc.c
+*
+* @brief Wakeup backend on the legacy rtc ioctls (/dev/rtc).
+*
+* The rtc has a single wall clock alarm with a resolution of seconds;
+* expiries are rounded up to the next second. Its fd becomes readable
+* with RTC_AF set when the alarm fires.
+***************************************************************
+*/
+
+#include <time.h>
+#include <stdbool.h>
+#include <glib.h>
+#include "rtc.h"
+#include "wakeup.h"
+#include "timespec.h"
+
+/**
+ * @addtogroup RTCAlarms
+ * @{
+ */
+
+static WakeupFunc fired_func = NULL;
+
+static void
+rtc_fired(void)
+{
+	fired_func(ALARM_CLOCK_REALTIME);
+}
+
+static bool
+rtc_backend_open(WakeupFunc func, bool forced)
+{
+	fired_func = func;
+
+	if (!rtc_open())
+	{
+		return false;
+	}
+
+	return rtc_add_watch(rtc_fired);
+}
+
+static void
+rtc_backend_close(void)
+{
+	rtc_close();
+}
+
+static bool
+rtc_backend_set(AlarmClock clock, const struct timespec *expiry)
+{
+	return rtc_set_alarm_time(rtc_from_wall(timespec_ceil_sec(expiry)));
+}
+
+static bool
+rtc_backend_clear(AlarmClock clock)
+{
+	return rtc_clear_alarm();
+}
+
+const struct wakeup_backend wakeup_rtc_backend =
+{
+	.name = "rtc",
+	.clocks = ALARM_CLOCK_MASK(ALARM_CLOCK_REALTIME),
+	.notifies = true,
+	.follows_clock_set = false,
+	.programs_rtc = true,
+	.open = rtc_backend_open,
+	.close = rtc_backend_close,
+	.set = rtc_backend_set,
+	.clear = rtc_backend_clear,
+};
+
+/* @} END OF RTCAlarms */
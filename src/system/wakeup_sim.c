@@ -0,0 +1,214 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+****************************************************************
+* @file wakeup_sim.c
+*
+* @brief Simulated wakeup backend running on virtual clocks.
+*
+* Nothing is programmed into any device: armed expiries are only
+* recorded, and time moves solely through wakeup_sim_advance(), which
+* fires every wakeup that falls into the advanced interval. This lets
+* the scheduling logic replay a day of alarm traffic in a fraction of a
+* second and count what it would have cost on a device. The backend is
+* never probed and has to be forced with NYX_SYSTEM_WAKEUP_BACKEND=sim.
+***************************************************************
+*/
+
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <stdbool.h>
+#include <glib.h>
+#include "dispatch.h"
+#include "wakeup.h"
+#include "timespec.h"
+
+/**
+ * @addtogroup RTCAlarms
+ * @{
+ */
+
+static WakeupFunc fired_func = NULL;
+static bool sim_open_flag = false;
+static int64_t sim_now[ALARM_CLOCK_COUNT];
+static struct timespec sim_armed[ALARM_CLOCK_COUNT];
+static uint64_t sim_wakeups = 0;
+static uint64_t sim_programs = 0;
+
+static bool
+sim_open(WakeupFunc func, bool forced)
+{
+	static const clockid_t clockids[ALARM_CLOCK_COUNT] =
+	{
+		CLOCK_REALTIME,
+		CLOCK_BOOTTIME,
+	};
+	guint c;
+
+	if (!forced)
+	{
+		return false;
+	}
+
+	/* the virtual clocks start out at the real time */
+	for (c = 0; c < ALARM_CLOCK_COUNT; c++)
+	{
+		struct timespec now;
+
+		clock_gettime(clockids[c], &now);
+		sim_now[c] = timespec_to_ns(&now);
+		memset(&sim_armed[c], 0, sizeof(sim_armed[c]));
+	}
+
+	fired_func = func;
+	sim_wakeups = 0;
+	sim_programs = 0;
+	sim_open_flag = true;
+
+	return true;
+}
+
+static void
+sim_close(void)
+{
+	sim_open_flag = false;
+}
+
+static bool
+sim_set(AlarmClock clock, const struct timespec *expiry)
+{
+	sim_armed[clock] = *expiry;
+	sim_programs++;
+
+	return true;
+}
+
+static bool
+sim_clear(AlarmClock clock)
+{
+	memset(&sim_armed[clock], 0, sizeof(sim_armed[clock]));
+	sim_programs++;
+
+	return true;
+}
+
+static void
+sim_clock_now(AlarmClock clock, struct timespec *now)
+{
+	*now = timespec_from_ns(sim_now[clock]);
+}
+
+bool
+wakeup_sim_active(void)
+{
+	return sim_open_flag;
+}
+
+/**
+* @brief Move the virtual clocks forward by ns, firing every armed
+* wakeup on the way at its exact expiry.
+*/
+
+void
+wakeup_sim_advance(int64_t ns)
+{
+	g_return_if_fail(sim_open_flag && ns >= 0);
+
+	dispatch_lock();
+
+	for (;;)
+	{
+		int64_t step = ns;
+		int next = -1;
+		guint c;
+
+		for (c = 0; c < ALARM_CLOCK_COUNT; c++)
+		{
+			int64_t due;
+
+			if (!timespec_is_set(&sim_armed[c]))
+			{
+				continue;
+			}
+
+			due = timespec_to_ns(&sim_armed[c]) - sim_now[c];
+
+			if (due < 0)
+			{
+				due = 0;
+			}
+
+			if (due <= step)
+			{
+				step = due;
+				next = c;
+			}
+		}
+
+		for (c = 0; c < ALARM_CLOCK_COUNT; c++)
+		{
+			sim_now[c] += step;
+		}
+
+		ns -= step;
+
+		if (next < 0)
+		{
+			break;
+		}
+
+		memset(&sim_armed[next], 0, sizeof(sim_armed[next]));
+		sim_wakeups++;
+		fired_func(next);
+	}
+
+	dispatch_unlock();
+}
+
+void
+wakeup_sim_counts(uint64_t *wakeups, uint64_t *programs)
+{
+	if (wakeups)
+	{
+		*wakeups = sim_wakeups;
+	}
+
+	if (programs)
+	{
+		*programs = sim_programs;
+	}
+}
+
+const struct wakeup_backend wakeup_sim_backend =
+{
+	.name = "sim",
+	.clocks = ALARM_CLOCK_MASK(ALARM_CLOCK_REALTIME) |
+	          ALARM_CLOCK_MASK(ALARM_CLOCK_BOOTTIME),
+	.notifies = true,
+	.follows_clock_set = true,
+	.programs_rtc = false,
+	.open = sim_open,
+	.close = sim_close,
+	.set = sim_set,
+	.clear = sim_clear,
+	.now = sim_clock_now,
+};
+
+/* @} END OF RTCAlarms */
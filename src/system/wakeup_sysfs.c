@@ -0,0 +1,245 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+****************************************************************
+* @file wakeup_sysfs.c
+*
+* @brief Wakeup backend on /sys/class/rtc/rtcN/wakealarm.
+*
+* The attribute takes seconds since the epoch (expiries are rounded up
+* to the next second), refuses times that are
+* not in the future and must be reset to 0 before a new alarm can be
+* written. It cannot tell us when the alarm fired, so expiry is
+* signalled by a plain timerfd set up by the caller.
+***************************************************************
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdbool.h>
+#include <glib.h>
+#include "config.h"
+#include "rtc.h"
+#include "wakeup.h"
+#include "timespec.h"
+#include "syscall_stats.h"
+
+#define SYSFS_RTC_CLASS "/sys/class/rtc"
+
+/**
+ * @addtogroup RTCAlarms
+ * @{
+ */
+
+static int32_t wakealarm_fd = -1;
+static bool wakealarm_armed = false;
+
+static bool
+is_hctosys(const gchar *rtc)
+{
+	gchar *path = g_build_path("/", SYSFS_RTC_CLASS, rtc, "hctosys", NULL);
+	gchar *contents = NULL;
+	bool ret = false;
+
+	if (g_file_get_contents(path, &contents, NULL, NULL))
+	{
+		ret = contents[0] == '1';
+		g_free(contents);
+	}
+
+	g_free(path);
+
+	return ret;
+}
+
+/**
+* @brief Find the rtc to use: the configured one, otherwise the one the
+* system clock was set from, otherwise the first with a wakealarm.
+*/
+
+static gchar *
+find_wakealarm(void)
+{
+	const char *name = config_get_string("WAKEUP_SYSFS_RTC", NULL);
+	gchar *found = NULL;
+	const gchar *entry;
+	GDir *dir;
+
+	if (name)
+	{
+		return g_build_path("/", SYSFS_RTC_CLASS, name, "wakealarm", NULL);
+	}
+
+	dir = g_dir_open(SYSFS_RTC_CLASS, 0, NULL);
+
+	if (!dir)
+	{
+		return NULL;
+	}
+
+	while ((entry = g_dir_read_name(dir)) != NULL)
+	{
+		gchar *path = g_build_path("/", SYSFS_RTC_CLASS, entry, "wakealarm", NULL);
+
+		if (!g_file_test(path, G_FILE_TEST_EXISTS))
+		{
+			g_free(path);
+			continue;
+		}
+
+		if (is_hctosys(entry))
+		{
+			g_free(found);
+			found = path;
+			break;
+		}
+
+		if (!found)
+		{
+			found = path;
+		}
+		else
+		{
+			g_free(path);
+		}
+	}
+
+	g_dir_close(dir);
+
+	return found;
+}
+
+static bool
+wakealarm_write(time_t value)
+{
+	char buf[32];
+	int len = snprintf(buf, sizeof(buf), "%ld", (long)value);
+
+	syscall_stats_inc(SYSCALL_SYSFS_WRITE);
+
+	if (pwrite(wakealarm_fd, buf, len, 0) != len)
+	{
+		g_critical("%s: could not write %s to wakealarm %d", __FUNCTION__, buf, errno);
+		return false;
+	}
+
+	return true;
+}
+
+static bool
+sysfs_open(WakeupFunc func, bool forced)
+{
+	gchar *path = find_wakealarm();
+
+	if (!path)
+	{
+		return false;
+	}
+
+	syscall_stats_inc(SYSCALL_DEV_OPEN);
+	wakealarm_fd = open(path, O_RDWR | O_CLOEXEC);
+
+	if (wakealarm_fd < 0)
+	{
+		g_debug("%s: could not open %s %d", __FUNCTION__, path, errno);
+		g_free(path);
+		return false;
+	}
+
+	g_free(path);
+	wakealarm_armed = true;
+
+	return true;
+}
+
+static void
+sysfs_close(void)
+{
+	if (wakealarm_fd >= 0)
+	{
+		syscall_stats_inc(SYSCALL_DEV_CLOSE);
+		close(wakealarm_fd);
+		wakealarm_fd = -1;
+	}
+}
+
+static bool
+sysfs_clear(AlarmClock clock)
+{
+	if (!wakealarm_armed)
+	{
+		return true;
+	}
+
+	if (!wakealarm_write(0))
+	{
+		return false;
+	}
+
+	wakealarm_armed = false;
+
+	return true;
+}
+
+static bool
+sysfs_set(AlarmClock clock, const struct timespec *expiry)
+{
+	/* wakealarm takes RTC time, and disables an alarm that is already
+	 * past on the RTC, which may be behind the wall clock */
+	time_t seconds = rtc_from_wall(timespec_ceil_sec(expiry));
+	time_t now = rtc_time(NULL);
+
+	if (now < 0)
+	{
+		now = rtc_from_wall(time(NULL));
+	}
+
+	if (seconds <= now)
+	{
+		seconds = now + 1;
+	}
+
+	if (!sysfs_clear(clock) || !wakealarm_write(seconds))
+	{
+		return false;
+	}
+
+	wakealarm_armed = true;
+
+	return true;
+}
+
+const struct wakeup_backend wakeup_sysfs_backend =
+{
+	.name = "sysfs",
+	.clocks = ALARM_CLOCK_MASK(ALARM_CLOCK_REALTIME),
+	.notifies = false,
+	.follows_clock_set = false,
+	.programs_rtc = true,
+	.open = sysfs_open,
+	.close = sysfs_close,
+	.set = sysfs_set,
+	.clear = sysfs_clear,
+};
+
+/* @} END OF RTCAlarms */
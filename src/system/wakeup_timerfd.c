@@ -0,0 +1,148 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2010-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+/*
+****************************************************************
+* @file wakeup_timerfd.c
+*
+* @brief Wakeup backend on timerfd with CLOCK_REALTIME_ALARM and
+* CLOCK_BOOTTIME_ALARM (Linux 3.11+, needs CAP_WAKE_ALARM). One
+* timerfd_settime() per alarm both wakes the device and tells us the
+* alarm expired.
+*
+* When forced by configuration and the alarm clocks are not available
+* the backend falls back to the plain clocks. Alarms then do not wake
+* a suspended device, which is what we want on a desktop host.
+***************************************************************
+*/
+
+#include <errno.h>
+#include <time.h>
+#include <stdbool.h>
+#include <glib.h>
+#include "alarm_timer.h"
+#include "wakeup.h"
+
+#ifndef CLOCK_REALTIME_ALARM
+#define CLOCK_REALTIME_ALARM 8
+#endif
+
+#ifndef CLOCK_BOOTTIME_ALARM
+#define CLOCK_BOOTTIME_ALARM 9
+#endif
+
+/**
+ * @addtogroup RTCAlarms
+ * @{
+ */
+
+static WakeupFunc fired_func = NULL;
+
+static struct alarm_timer timers[ALARM_CLOCK_COUNT] =
+{
+	ALARM_TIMER_INIT,
+	ALARM_TIMER_INIT,
+};
+
+static void
+timerfd_fired(struct alarm_timer *timer)
+{
+	fired_func(timer == &timers[ALARM_CLOCK_BOOTTIME] ?
+	           ALARM_CLOCK_BOOTTIME : ALARM_CLOCK_REALTIME);
+}
+
+static void
+timerfd_close(void)
+{
+	guint c;
+
+	for (c = 0; c < ALARM_CLOCK_COUNT; c++)
+	{
+		alarm_timer_close(&timers[c]);
+	}
+}
+
+static bool
+timerfd_open(WakeupFunc func, bool forced)
+{
+	static const clockid_t alarm_clockids[ALARM_CLOCK_COUNT] =
+	{
+		CLOCK_REALTIME_ALARM,
+		CLOCK_BOOTTIME_ALARM,
+	};
+	static const clockid_t plain_clockids[ALARM_CLOCK_COUNT] =
+	{
+		CLOCK_REALTIME,
+		CLOCK_BOOTTIME,
+	};
+	const clockid_t *clockids = alarm_clockids;
+	guint c;
+
+	fired_func = func;
+
+	if (!alarm_timer_open(&timers[0], clockids[0], timerfd_fired))
+	{
+		if (!forced)
+		{
+			return false;
+		}
+
+		g_warning("%s: alarm clocks not available (%d), alarms will not "
+		          "wake the device", __FUNCTION__, errno);
+		clockids = plain_clockids;
+	}
+
+	for (c = 0; c < ALARM_CLOCK_COUNT; c++)
+	{
+		if (!alarm_timer_open(&timers[c], clockids[c], timerfd_fired))
+		{
+			timerfd_close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool
+timerfd_set(AlarmClock clock, const struct timespec *expiry)
+{
+	return alarm_timer_set(&timers[clock], expiry);
+}
+
+static bool
+timerfd_clear(AlarmClock clock)
+{
+	return alarm_timer_clear(&timers[clock]);
+}
+
+const struct wakeup_backend wakeup_timerfd_backend =
+{
+	.name = "timerfd",
+	.clocks = ALARM_CLOCK_MASK(ALARM_CLOCK_REALTIME) |
+	          ALARM_CLOCK_MASK(ALARM_CLOCK_BOOTTIME),
+	.notifies = true,
+	.follows_clock_set = true,
+	.programs_rtc = false,
+	.open = timerfd_open,
+	.close = timerfd_close,
+	.set = timerfd_set,
+	.clear = timerfd_clear,
+};
+
+/* @} END OF RTCAlarms */